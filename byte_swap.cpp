@@ -0,0 +1,163 @@
+#include "byte_swap.h"
+#include <string.h>
+#include <stdint.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define BYTE_SWAP_X86
+#include <immintrin.h>
+#endif
+
+typedef void (*swap_kernel)(const void * src, void * dst, size_t count);
+
+static void swap_bytes_16_scalar(const void * src, void * dst, size_t count)
+{
+    const char * in = static_cast<const char*>(src);
+    char * out = static_cast<char*>(dst);
+    for (size_t i = 0; i < count; i++)
+    {
+        uint16_t value;
+        memcpy(&value, in + 2 * i, 2);
+        value = __builtin_bswap16(value);
+        memcpy(out + 2 * i, &value, 2);
+    }
+}
+
+static void swap_bytes_32_scalar(const void * src, void * dst, size_t count)
+{
+    const char * in = static_cast<const char*>(src);
+    char * out = static_cast<char*>(dst);
+    for (size_t i = 0; i < count; i++)
+    {
+        uint32_t value;
+        memcpy(&value, in + 4 * i, 4);
+        value = __builtin_bswap32(value);
+        memcpy(out + 4 * i, &value, 4);
+    }
+}
+
+#ifdef BYTE_SWAP_X86
+
+__attribute__((target("ssse3")))
+static void swap_bytes_16_ssse3(const void * src, void * dst, size_t count)
+{
+    const char * in = static_cast<const char*>(src);
+    char * out = static_cast<char*>(dst);
+    const __m128i mask = _mm_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + 2 * i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 2 * i), _mm_shuffle_epi8(v, mask));
+    }
+    swap_bytes_16_scalar(in + 2 * i, out + 2 * i, count - i);
+}
+
+__attribute__((target("ssse3")))
+static void swap_bytes_32_ssse3(const void * src, void * dst, size_t count)
+{
+    const char * in = static_cast<const char*>(src);
+    char * out = static_cast<char*>(dst);
+    const __m128i mask = _mm_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + 4 * i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 4 * i), _mm_shuffle_epi8(v, mask));
+    }
+    swap_bytes_32_scalar(in + 4 * i, out + 4 * i, count - i);
+}
+
+__attribute__((target("avx2")))
+static void swap_bytes_16_avx2(const void * src, void * dst, size_t count)
+{
+    const char * in = static_cast<const char*>(src);
+    char * out = static_cast<char*>(dst);
+    const __m256i mask = _mm256_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14,
+                                          1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+    size_t i = 0;
+    for (; i + 32 <= count; i += 32)
+    {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + 2 * i));
+        __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + 2 * i + 32));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + 2 * i), _mm256_shuffle_epi8(a, mask));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + 2 * i + 32), _mm256_shuffle_epi8(b, mask));
+    }
+    for (; i + 16 <= count; i += 16)
+    {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + 2 * i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + 2 * i), _mm256_shuffle_epi8(a, mask));
+    }
+    swap_bytes_16_scalar(in + 2 * i, out + 2 * i, count - i);
+}
+
+__attribute__((target("avx2")))
+static void swap_bytes_32_avx2(const void * src, void * dst, size_t count)
+{
+    const char * in = static_cast<const char*>(src);
+    char * out = static_cast<char*>(dst);
+    const __m256i mask = _mm256_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+                                          3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16)
+    {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + 4 * i));
+        __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + 4 * i + 32));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + 4 * i), _mm256_shuffle_epi8(a, mask));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + 4 * i + 32), _mm256_shuffle_epi8(b, mask));
+    }
+    for (; i + 8 <= count; i += 8)
+    {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + 4 * i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + 4 * i), _mm256_shuffle_epi8(a, mask));
+    }
+    swap_bytes_32_scalar(in + 4 * i, out + 4 * i, count - i);
+}
+
+#endif // BYTE_SWAP_X86
+
+struct swap_kernels
+{
+    swap_kernel swap16;
+    swap_kernel swap32;
+    const char * name;
+
+    swap_kernels() : swap16(swap_bytes_16_scalar), swap32(swap_bytes_32_scalar), name("scalar")
+    {
+#ifdef BYTE_SWAP_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2"))
+        {
+            swap16 = swap_bytes_16_avx2;
+            swap32 = swap_bytes_32_avx2;
+            name = "avx2";
+        }
+        else if (__builtin_cpu_supports("ssse3"))
+        {
+            swap16 = swap_bytes_16_ssse3;
+            swap32 = swap_bytes_32_ssse3;
+            name = "ssse3";
+        }
+#endif
+    }
+};
+
+static const swap_kernels& kernels()
+{
+    static const swap_kernels instance;
+    return instance;
+}
+
+void swap_bytes_16(const void * src, void * dst, size_t count)
+{
+    kernels().swap16(src, dst, count);
+}
+
+void swap_bytes_32(const void * src, void * dst, size_t count)
+{
+    kernels().swap32(src, dst, count);
+}
+
+const char* swap_bytes_kernel_name()
+{
+    return kernels().name;
+}
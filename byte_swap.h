@@ -0,0 +1,15 @@
+#ifndef BYTE_SWAP_H
+#define BYTE_SWAP_H
+
+#include <cstddef>
+
+// Copy count 16/32-bit values from src to dst reversing the byte order of each one.
+// src and dst may be the same buffer, otherwise they must not overlap; no alignment is required.
+// The kernel is chosen once at run time: AVX2, SSSE3 or scalar.
+void swap_bytes_16(const void * src, void * dst, size_t count);
+void swap_bytes_32(const void * src, void * dst, size_t count);
+
+// Name of the kernel set in use, e.g. "avx2"
+const char* swap_bytes_kernel_name();
+
+#endif // BYTE_SWAP_H
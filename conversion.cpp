@@ -0,0 +1,321 @@
+#include "conversion.h"
+#include "parallel.h"
+#include "segy_index.h"
+#include "csv_reader.h"
+#include "gzip_file.h"
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <stdexcept>
+#include <algorithm>
+#include <mutex>
+#include <condition_variable>
+#include <glob.h>
+#include <sys/stat.h>
+
+// Seismograms of a thread, kept between shots so that their storage is reused
+template <int dims>
+CombinedSeismogramm<float, dims>& thread_seismogramm()
+{
+    typedef typename CombinedSeismogramm<float, dims>::Elastic SeismoElastic;
+    static thread_local CombinedSeismogramm<float, dims> s;
+    if (s.componentInfos.empty())
+    {
+        s.AddComponent("", new VxGetter<SeismoElastic, dims>());
+        s.AddComponent("", new VyGetter<SeismoElastic, dims>());
+        if (dims >= 3)
+            s.AddComponent("", new VzGetter<SeismoElastic, dims>());
+    }
+    return s;
+}
+
+// Gives back the storage of the thread's seismograms that is bigger than bytes
+template <int dims>
+void trim_thread_seismogramm(size_t bytes)
+{
+    CombinedSeismogramm<float, dims>& s = thread_seismogramm<dims>();
+    for (size_t k = 0; k < s.seismogramms.size(); k++)
+    {
+        if (s.seismogramms[k].data.capacity() * sizeof(float) > bytes)
+            TraceMatrix<float>().swap(s.seismogramms[k].data);
+    }
+}
+
+size_t file_size(const std::string& path)
+{
+    struct stat st;
+    return (::stat(path.c_str(), &st) == 0) ? st.st_size : 0;
+}
+
+// CSV text usually compresses about this many times
+#define GZIP_CSV_RATIO 4
+
+// Bytes of text of the CSV file of a shot, estimated for a .csv.gz file
+size_t csv_text_size(const std::string& csv_path)
+{
+    const std::string path = find_csv_file(csv_path);
+    return file_size(path) * (is_gzip_path(path) ? GZIP_CSV_RATIO : 1);
+}
+
+template <int dims>
+void convert(const ConversionShot& shot, const ConversionOptions& options, int num_threads, size_t max_memory)
+{
+    CombinedSeismogramm<float, dims>& s = thread_seismogramm<dims>();
+    s.interpolation_multiplier = options.interpolation_coef;
+    s.resampling = options.resampling;
+    s.sample_format = options.segy_format;
+    s.csv_format = options.csv_format;
+    s.csv_gzip = options.csv_gzip;
+    s.num_threads = num_threads;
+    s.segy_window = options.segy_window;
+    s.segy_read_options = options.segy_read_options;
+    s.segy_query = options.segy_query;
+
+    std::vector<std::string> csv_files;
+    csv_files.push_back(shot.csv_path);
+    const char * suffixes[3] = { "_x.segy", "_y.segy", "_z.segy" };
+    std::vector<std::string> segy_files;
+    for (int k = 0; k < dims; k++)
+        segy_files.push_back(shot.segy_path + suffixes[k]);
+
+    switch (options.type)
+    {
+        case TO_CSV:
+        // A window or a query is usually a small part of the files, it is loaded with direct reads
+        if (options.segy_window.IsWhole() && options.segy_query.IsEmpty())
+        {
+            s.ConvertSegYToCsv(segy_files, csv_files, max_memory);
+        }
+        else
+        {
+            s.Load(SEG_Y, segy_files);
+            s.Save(CSV, csv_files);
+        }
+        break;
+
+        case TO_NPY:
+        s.Load(SEG_Y, segy_files);
+        s.Save(NPY, csv_files);
+        break;
+
+        case FROM_NPY:
+        s.Load(NPY, csv_files);
+        s.Save(SEG_Y, segy_files);
+        break;
+
+        case BUILD_INDEX:
+        for (int k = 0; k < dims; k++)
+        {
+            SegYIndex index;
+            index.Open(segy_files[k]);
+        }
+        break;
+
+        default:
+        // A CSV file bigger than the memory of the shot is transposed through temporary files
+        if (csv_text_size(shot.csv_path) > max_memory)
+        {
+            s.ConvertCsvToSegY(csv_files, segy_files, max_memory);
+        }
+        else
+        {
+            s.Load(CSV, csv_files);
+            s.Save(SEG_Y, segy_files);
+        }
+        break;
+    }
+}
+
+void convert_shot(const ConversionShot& shot, const ConversionOptions& options, int num_threads, size_t max_memory)
+{
+    if (options.dims == 3)
+        convert<3>(shot, options, num_threads, max_memory);
+    else
+        convert<2>(shot, options, num_threads, max_memory);
+}
+
+void convert_shot(const ConversionShot& shot, const ConversionOptions& options)
+{
+    convert_shot(shot, options, options.num_threads, options.max_memory);
+}
+
+bool ends_with(const std::string& str, const std::string& suffix)
+{
+    return str.size() >= suffix.size() && str.compare(str.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+std::vector<ConversionShot> read_batch_shots(const std::string& source, const ConversionOptions& options)
+{
+    std::vector<ConversionShot> shots;
+    if (source.find_first_of("*?[") != std::string::npos)
+    {
+        const char * suffixes[] = { ".csv", "_x.segy", "_x.segy", "_x.npy", "_x.segy" };
+        glob_t matches;
+        int result = ::glob(source.c_str(), 0, NULL, &matches);
+        if (result != 0 && result != GLOB_NOMATCH)
+        {
+            throw std::runtime_error("Error in reading batch pattern: " + source);
+        }
+        for (size_t i = 0; result == 0 && i < matches.gl_pathc; i++)
+        {
+            std::string path = matches.gl_pathv[i];
+            std::string suffix = suffixes[options.type];
+            if (options.type == TO_SEGY && ends_with(path, ".csv.gz"))
+                suffix = ".csv.gz";
+            if (!ends_with(path, suffix))
+            {
+                ::globfree(&matches);
+                throw std::runtime_error("Error in batch pattern " + source + ": " + path + " doesn't end with " + suffix);
+            }
+            std::string base = path.substr(0, path.size() - suffix.size());
+            shots.push_back(ConversionShot(base, base));
+        }
+        if (result == 0)
+            ::globfree(&matches);
+    }
+    else
+    {
+        std::ifstream manifest(source.c_str());
+        if (!manifest)
+        {
+            throw std::runtime_error("Error in reading batch manifest.\nThere is no such file: " + source);
+        }
+        std::string line;
+        while (std::getline(manifest, line))
+        {
+            std::istringstream fields(line);
+            std::string segy_path, csv_path;
+            if (!(fields >> segy_path) || segy_path[0] == '#')
+                continue;
+            if (!(fields >> csv_path))
+                csv_path = segy_path;
+            shots.push_back(ConversionShot(segy_path, csv_path));
+        }
+    }
+    return shots;
+}
+
+// Bytes that shots converted at the same time may use together
+class MemoryBudget
+{
+public:
+
+    explicit MemoryBudget(size_t limit) : limit(limit), used(0) {}
+
+    // Waits until bytes are available and takes them, at most the whole budget is taken
+    size_t Acquire(size_t bytes)
+    {
+        bytes = std::min(std::max<size_t>(bytes, 1), limit);
+        std::unique_lock<std::mutex> guard(lock);
+        released.wait(guard, [&]() { return used + bytes <= limit; });
+        used += bytes;
+        return bytes;
+    }
+    void Release(size_t bytes)
+    {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            used -= bytes;
+        }
+        released.notify_all();
+    }
+
+private:
+
+    size_t limit;
+    size_t used;
+    std::mutex lock;
+    std::condition_variable released;
+};
+
+size_t shot_input_size(const ConversionShot& shot, const ConversionOptions& options)
+{
+    const char * segy_suffixes[3] = { "_x.segy", "_y.segy", "_z.segy" };
+    const char * npy_suffixes[3] = { "_x.npy", "_y.npy", "_z.npy" };
+    size_t size = 0;
+    switch (options.type)
+    {
+        case TO_SEGY:
+        return csv_text_size(shot.csv_path);
+
+        case FROM_NPY:
+        for (int k = 0; k < options.dims; k++)
+            size += file_size(shot.csv_path + npy_suffixes[k]);
+        return size;
+
+        default:
+        for (int k = 0; k < options.dims; k++)
+            size += file_size(shot.segy_path + segy_suffixes[k]);
+        return size;
+    }
+}
+
+// Memory a shot is expected to need: the rows of the resampled output for
+// tocsv, about two copies of the samples (loaded and resampled) otherwise;
+// in CSV a sample usually takes more than 8 characters of text
+size_t shot_memory(const ConversionShot& shot, const ConversionOptions& options)
+{
+    switch (options.type)
+    {
+        case TO_CSV:
+        return shot_input_size(shot, options) / std::max(options.interpolation_coef, 0.001f);
+
+        case TO_NPY:
+        case FROM_NPY:
+        return 2 * shot_input_size(shot, options);
+
+        case BUILD_INDEX:
+        return 0;
+
+        default:
+        return shot_input_size(shot, options);
+    }
+}
+
+size_t run_batch(const std::vector<ConversionShot>& shots, const ConversionOptions& options)
+{
+    int workers = (options.num_threads > 0) ? options.num_threads : default_num_threads();
+    workers = std::max(1, std::min<int>(workers, shots.size()));
+    // Threads left over when there are fewer shots than threads go to the shots
+    int shot_threads = std::max(1, ((options.num_threads > 0) ? options.num_threads : default_num_threads()) / workers);
+
+    MemoryBudget budget(options.max_memory);
+    std::vector<std::string> errors(shots.size());
+    std::vector<char> failed(shots.size(), 0);
+    parallel_for_stealing(shots.size(), workers, [&](size_t i)
+    {
+        size_t memory = budget.Acquire(shot_memory(shots[i], options));
+        try
+        {
+            convert_shot(shots[i], options, shot_threads, memory);
+        }
+        catch (const std::exception& e)
+        {
+            errors[i] = e.what();
+            failed[i] = 1;
+        }
+        catch (...)
+        {
+            errors[i] = "Unknown error";
+            failed[i] = 1;
+        }
+        // Buffers kept for the next shot stay within the share of a thread
+        if (options.dims == 3)
+            trim_thread_seismogramm<3>(options.max_memory / workers);
+        else
+            trim_thread_seismogramm<2>(options.max_memory / workers);
+        budget.Release(memory);
+    });
+
+    size_t num_failed = std::count(failed.begin(), failed.end(), 1);
+    std::cout << "Batch: " << shots.size() - num_failed << " of " << shots.size() << " shots converted" << std::endl;
+    for (size_t i = 0; i < shots.size(); i++)
+    {
+        if (failed[i])
+        {
+            std::cout << "Failed shot " << shots[i].segy_path << " / " << shots[i].csv_path << ":\n"
+                      << errors[i] << std::endl;
+        }
+    }
+    return num_failed;
+}
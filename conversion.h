@@ -0,0 +1,76 @@
+#ifndef CONVERSION_H
+#define CONVERSION_H
+
+#include <string>
+#include <vector>
+#include <cstddef>
+#include "seismogram.h"
+
+// Directions of conversion: "tosegy" (CSV to SEG-Y), "tocsv", "tonpy" (SEG-Y to NPY) and "fromnpy";
+// "index" builds the trace header indexes (<file>.segy.idx) of the SEG-Y files, up to date ones are kept
+enum ConversionType
+{
+    TO_SEGY, TO_CSV, TO_NPY, FROM_NPY, BUILD_INDEX
+};
+
+// Settings shared by all the shots of a run
+struct ConversionOptions
+{
+    ConversionType type;
+    int dims;
+    float interpolation_coef;
+    ResamplingType resampling;
+    int segy_format;
+    CsvNumberFormat csv_format;
+    // Memory for buffered rows of one shot, or for all the shots of a batch together
+    size_t max_memory;
+    // 0 - one per hardware thread
+    int num_threads;
+    // Part of the SEG-Y files read by tocsv and tonpy
+    SegYWindow segy_window;
+    // Whether tocsv writes <csv_path>.csv.gz
+    bool csv_gzip;
+    // How tocsv and tonpy read the SEG-Y files
+    SegYReadOptions segy_read_options;
+    // Traces tocsv and tonpy read through the indexes of the SEG-Y files
+    SegYTraceQuery segy_query;
+
+    ConversionOptions() : type(TO_SEGY), dims(2), interpolation_coef(1.0), resampling(LINEAR_RESAMPLING),
+        segy_format(5), max_memory(256 * 1024 * 1024), num_threads(0), csv_gzip(false) {}
+};
+
+// One shot: SEG-Y files <segy_path>_x.segy, <segy_path>_y.segy (and
+// <segy_path>_z.segy in 3D) and the CSV file <csv_path>.csv (or .csv.gz) or the NPY
+// arrays <csv_path>_x.npy, ...
+struct ConversionShot
+{
+    std::string segy_path;
+    std::string csv_path;
+
+    ConversionShot(const std::string& segy_path, const std::string& csv_path) : segy_path(segy_path), csv_path(csv_path) {}
+};
+
+// Converts one shot, throws std::runtime_error on failure
+void convert_shot(const ConversionShot& shot, const ConversionOptions& options);
+
+// Bytes of the input files of a shot: the text of the .csv file for tosegy, the .npy
+// components for fromnpy and the .segy files otherwise
+size_t shot_input_size(const ConversionShot& shot, const ConversionOptions& options);
+
+// Shots of a batch. source is either a glob pattern or a manifest file.
+// A pattern matches the input files: <base>_x.segy for tocsv, tonpy and index,
+// <base>.csv or <base>.csv.gz for tosegy or <base>_x.npy for fromnpy; the output of a shot
+// gets the same base name. A manifest has a line per shot with the SEG-Y
+// and CSV (or NPY) names ("seismo input") or a single name used for both;
+// empty lines and lines starting with '#' are skipped.
+std::vector<ConversionShot> read_batch_shots(const std::string& source, const ConversionOptions& options);
+
+// Converts the shots concurrently on options.num_threads threads, which
+// take whole shots and steal them from each other when they run out.
+// Shots converted at the same time share options.max_memory, a shot that
+// would need more than all of it runs alone. A failed shot doesn't stop the
+// others, failures are printed once all the shots are done.
+// Returns the number of failed shots.
+size_t run_batch(const std::vector<ConversionShot>& shots, const ConversionOptions& options);
+
+#endif // CONVERSION_H
@@ -0,0 +1,189 @@
+#include "csv_reader.h"
+#include <charconv>
+#include <algorithm>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+double parse_double(const char * begin, const char * end)
+{
+    while (begin < end && (*begin == ' ' || *begin == '\t'))
+        begin++;
+    if (begin < end && *begin == '+')
+        begin++;
+    double value = 0.0;
+    std::from_chars(begin, end, value);
+    return value;
+}
+
+std::vector<const char*> split_line_chunks(const char * begin, const char * end, size_t count)
+{
+    count = std::max<size_t>(count, 1);
+    std::vector<const char*> bounds(count + 1, end);
+    bounds[0] = begin;
+    size_t size = end - begin;
+    for (size_t i = 1; i < count; i++)
+    {
+        const char * pos = std::max(bounds[i - 1], begin + size / count * i);
+        // A piece starts right after a newline
+        if (pos > begin && pos < end && pos[-1] != '\n')
+        {
+            const char * newline = static_cast<const char*>(memchr(pos, '\n', end - pos));
+            pos = newline ? newline + 1 : end;
+        }
+        bounds[i] = pos;
+    }
+    return bounds;
+}
+
+size_t count_lines(const char * begin, const char * end)
+{
+    size_t count = 0;
+    const char * pos = begin;
+    while (pos < end)
+    {
+        const char * newline = static_cast<const char*>(memchr(pos, '\n', end - pos));
+        if (!newline)
+            return count + 1;
+        count++;
+        pos = newline + 1;
+    }
+    return count;
+}
+
+CsvLine::CsvLine(char delim) : delim(delim), line_begin(0), line_end(0)
+{
+    cell_begins.push_back(0);
+}
+
+void CsvLine::Clear()
+{
+    line_begin = line_end = 0;
+    cell_begins.resize(1);
+}
+
+void CsvLine::Split(const char * begin, const char * end)
+{
+    line_begin = begin;
+    line_end = end;
+    cell_begins.clear();
+    const char * pos = line_begin;
+    while (pos < line_end)
+    {
+        cell_begins.push_back(pos);
+        const char * next = static_cast<const char*>(memchr(pos, delim, line_end - pos));
+        if (!next)
+        {
+            pos = line_end + 1;
+            break;
+        }
+        pos = next + 1;
+    }
+    if (cell_begins.empty())
+        pos = line_end + 1;
+    cell_begins.push_back(pos);
+}
+
+bool CsvLine::CellEquals(size_t i, const char * str) const
+{
+    size_t length = strlen(str);
+    return size_t(CellEnd(i) - CellBegin(i)) == length && memcmp(CellBegin(i), str, length) == 0;
+}
+
+double CsvLine::CellAsDouble(size_t i) const
+{
+    return parse_double(CellBegin(i), CellEnd(i));
+}
+
+CsvReader::CsvReader(char delim, size_t buffer_size) :
+    fd(-1), file_size(0), eof(true), buffer(buffer_size),
+    data_begin(0), data_end(0), line(delim)
+{
+}
+
+CsvReader::~CsvReader()
+{
+    Close();
+}
+
+bool CsvReader::Open(const std::string& path)
+{
+    Close();
+    fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+    struct stat st;
+    file_size = (::fstat(fd, &st) == 0) ? st.st_size : 0;
+    ::posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    eof = false;
+    return true;
+}
+
+void CsvReader::Close()
+{
+    if (fd >= 0)
+        ::close(fd);
+    fd = -1;
+    file_size = 0;
+    eof = true;
+    data_begin = data_end = 0;
+    line.Clear();
+}
+
+bool CsvReader::fill()
+{
+    if (eof)
+        return false;
+    if (data_begin > 0)
+    {
+        memmove(&buffer[0], &buffer[data_begin], data_end - data_begin);
+        data_end -= data_begin;
+        data_begin = 0;
+    }
+    if (data_end == buffer.size())
+        buffer.resize(buffer.size() * 2);
+
+    ssize_t count;
+    do
+    {
+        count = ::read(fd, &buffer[data_end], buffer.size() - data_end);
+    } while (count < 0 && errno == EINTR);
+    if (count <= 0)
+    {
+        eof = true;
+        return false;
+    }
+    data_end += count;
+    return true;
+}
+
+bool CsvReader::ReadLine()
+{
+    line.Clear();
+    size_t scanned = data_begin;
+    const char * newline;
+    while (!(newline = static_cast<const char*>(memchr(&buffer[0] + scanned, '\n', data_end - scanned))))
+    {
+        scanned = data_end - data_begin;
+        if (!fill())
+            break;
+    }
+    if (!newline && data_begin == data_end)
+        return false;
+    const char * line_begin = &buffer[0] + data_begin;
+    const char * line_end = newline ? newline : &buffer[0] + data_end;
+    data_begin = (line_end - &buffer[0]) + (newline ? 1 : 0);
+    line.Split(line_begin, line_end);
+    return true;
+}
+
+std::string find_csv_file(const std::string& base)
+{
+    struct stat st;
+    const std::string path = base + ".csv";
+    if (::stat(path.c_str(), &st) != 0 && ::stat((path + ".gz").c_str(), &st) == 0)
+        return path + ".gz";
+    return path;
+}
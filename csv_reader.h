@@ -0,0 +1,95 @@
+#ifndef CSV_READER_H
+#define CSV_READER_H
+
+#include <string>
+#include <vector>
+#include <cstddef>
+
+// Cells of one line of delimiter separated text, split in place.
+// Splitting follows std::getline: a trailing delimiter doesn't start an
+// empty cell and a trailing '\r' stays in the last cell.
+class CsvLine
+{
+public:
+
+    explicit CsvLine(char delim = ';');
+
+    // Splits [begin, end), the text must stay alive while the cells are used
+    void Split(const char * begin, const char * end);
+    void Clear();
+
+    size_t NumCells() const { return cell_begins.size() - 1; }
+    size_t Length() const { return line_end - line_begin; }
+    const char* CellBegin(size_t i) const { return cell_begins[i]; }
+    const char* CellEnd(size_t i) const { return cell_begins[i + 1] - 1; }
+    bool CellEquals(size_t i, const char * str) const;
+    // Parses a cell like ::atof does: leading blanks are skipped, garbage gives 0
+    double CellAsDouble(size_t i) const;
+
+private:
+
+    char delim;
+    const char * line_begin;
+    const char * line_end;
+    // Beginnings of the cells followed by the position one past the end of the last cell + 1
+    std::vector<const char*> cell_begins;
+};
+
+// Single pass reader of delimiter separated text.
+// Lines are split in place inside one large read buffer, so reading a line
+// allocates nothing; cells stay valid until the next call of ReadLine.
+class CsvReader
+{
+public:
+
+    explicit CsvReader(char delim = ';', size_t buffer_size = 4 * 1024 * 1024);
+    ~CsvReader();
+
+    bool Open(const std::string& path);
+    void Close();
+    // Size of the opened file in bytes
+    size_t FileSize() const { return file_size; }
+
+    // Reads the next line, returns false (and leaves no cells) at the end of the file
+    bool ReadLine();
+
+    const CsvLine& Line() const { return line; }
+    size_t NumCells() const { return line.NumCells(); }
+    size_t LineLength() const { return line.Length(); }
+    const char* CellBegin(size_t i) const { return line.CellBegin(i); }
+    const char* CellEnd(size_t i) const { return line.CellEnd(i); }
+    bool CellEquals(size_t i, const char * str) const { return line.CellEquals(i, str); }
+    double CellAsDouble(size_t i) const { return line.CellAsDouble(i); }
+
+private:
+
+    CsvReader(const CsvReader&);
+    CsvReader& operator=(const CsvReader&);
+
+    // Moves the unread tail to the front of the buffer and reads more data,
+    // returns false if nothing could be read
+    bool fill();
+
+    int fd;
+    size_t file_size;
+    bool eof;
+    std::vector<char> buffer;
+    size_t data_begin, data_end;
+    CsvLine line;
+};
+
+// Parses [begin, end) like ::atof does
+double parse_double(const char * begin, const char * end);
+
+// Splits [begin, end) into at most count consecutive pieces that start at line beginnings.
+// Returns the count + 1 boundaries, empty pieces are possible for short texts.
+std::vector<const char*> split_line_chunks(const char * begin, const char * end, size_t count);
+
+// CSV file of a base name: <base>.csv, or <base>.csv.gz if only that one exists
+std::string find_csv_file(const std::string& base);
+
+// Number of lines in [begin, end) as CsvReader would read them:
+// every '\n' ends a line, a non-empty tail without '\n' is one more line
+size_t count_lines(const char * begin, const char * end);
+
+#endif // CSV_READER_H
@@ -0,0 +1,169 @@
+#include "csv_writer.h"
+#include "stats.h"
+#include "gzip_file.h"
+#include <charconv>
+#include <system_error>
+#include <algorithm>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+CsvWriter::CsvWriter(size_t buffer_size) : fd(-1), failed(false), buffer(buffer_size)
+{
+    pos = buffer.data();
+    buffer_end = buffer.data() + buffer.size();
+}
+
+CsvWriter::~CsvWriter()
+{
+    Close();
+}
+
+bool CsvWriter::Open(const std::string& path, int num_threads)
+{
+    Close();
+    failed = false;
+    if (is_gzip_path(path))
+    {
+        gzip.reset(new GzipWriter(num_threads));
+        if (!gzip->Open(path))
+        {
+            gzip.reset();
+            return false;
+        }
+        // Every thread gets at least a member to compress
+        if (buffer.size() < gzip->ParallelSize())
+        {
+            buffer.resize(gzip->ParallelSize());
+            buffer_end = buffer.data() + buffer.size();
+        }
+    }
+    else
+    {
+        fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    }
+    pos = buffer.data();
+    return is_open();
+}
+
+bool CsvWriter::Close()
+{
+    if (!is_open())
+        return !failed;
+    flush();
+    if (gzip)
+    {
+        if (!gzip->Close())
+            failed = true;
+        gzip.reset();
+    }
+    else if (::close(fd) != 0)
+    {
+        failed = true;
+    }
+    fd = -1;
+    return !failed;
+}
+
+void CsvWriter::SetNumberFormat(const CsvNumberFormat& number_format)
+{
+    format = number_format;
+    format.precision = std::max(0, std::min(format.precision, CSV_MAX_PRECISION));
+}
+
+void CsvWriter::flush(size_t count)
+{
+    if (!is_open())
+    {
+        size_t size = Size();
+        buffer.resize(std::max(buffer.size() * 2, size + count));
+        pos = buffer.data() + size;
+        buffer_end = buffer.data() + buffer.size();
+        return;
+    }
+    if (gzip)
+    {
+        if (!failed && !gzip->Write(buffer.data(), pos - buffer.data()))
+            failed = true;
+        pos = buffer.data();
+        return;
+    }
+    StatsTimer timer(STATS_WRITE, pos - buffer.data(), 0);
+    const char * data = buffer.data();
+    while (data < pos && !failed)
+    {
+        ssize_t count = ::write(fd, data, pos - data);
+        if (count < 0 && errno == EINTR)
+            continue;
+        if (count <= 0)
+            failed = true;
+        else
+            data += count;
+    }
+    pos = buffer.data();
+}
+
+void CsvWriter::Write(int value)
+{
+    reserve(16);
+    pos = std::to_chars(pos, pos + 16, value).ptr;
+}
+
+void CsvWriter::Write(const char * str)
+{
+    Write(str, strlen(str));
+}
+
+void CsvWriter::Write(const char * text, size_t length)
+{
+    if (is_open() && length > buffer.size())
+    {
+        flush();
+        while (length > 0)
+        {
+            size_t chunk = std::min(length, buffer.size());
+            memcpy(pos, text, chunk);
+            pos += chunk;
+            flush();
+            text += chunk;
+            length -= chunk;
+        }
+        return;
+    }
+    reserve(length);
+    memcpy(pos, text, length);
+    pos += length;
+}
+
+template <typename T>
+char* format_value(T value, const CsvNumberFormat& format, char * out)
+{
+    char * end = out + CSV_MAX_NUMBER_LENGTH;
+    std::to_chars_result result;
+    if (format.fixed)
+    {
+        result = std::to_chars(out, end, value, std::chars_format::fixed, format.precision);
+        // Large values don't fit in fixed format, they are written in scientific one
+        if (result.ec != std::errc())
+            result = std::to_chars(out, end, value, std::chars_format::scientific, format.precision);
+    }
+    else if (format.precision <= 0)
+        result = std::to_chars(out, end, value);
+    else
+        result = std::to_chars(out, end, value, std::chars_format::general, format.precision);
+    // Too many digits requested for the buffer, the shortest exact form always fits
+    if (result.ec != std::errc())
+        result = std::to_chars(out, end, value);
+    return result.ptr;
+}
+
+char* CsvWriter::format_number(float value, char * out) const
+{
+    return format_value(value, format, out);
+}
+
+char* CsvWriter::format_number(double value, char * out) const
+{
+    return format_value(value, format, out);
+}
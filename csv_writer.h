@@ -0,0 +1,101 @@
+#ifndef CSV_WRITER_H
+#define CSV_WRITER_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstddef>
+
+// Longest text format_number may produce
+#define CSV_MAX_NUMBER_LENGTH 128
+// Largest accepted precision
+#define CSV_MAX_PRECISION 60
+
+// How numbers are printed in CSV files
+struct CsvNumberFormat
+{
+    // Significant digits (like printf %.*g), 0 - shortest representation that reads back
+    // to the same value; with fixed - digits after the decimal point (like printf %.*f)
+    int precision;
+    bool fixed;
+
+    // The default matches std::ostream output (6 significant digits)
+    CsvNumberFormat(int precision = 6, bool fixed = false) : precision(precision), fixed(fixed) {}
+};
+
+class GzipWriter;
+
+// Writes text into a large reusable buffer that goes to the file in big
+// chunks; numbers are formatted with std::to_chars, without locales or streams.
+// A writer that isn't opened keeps all the text in its growing buffer, so
+// blocks of rows can be formatted concurrently and written out later.
+// A path ending with ".gz" gets gzip compressed text, the buffer is then
+// compressed in blocks on num_threads threads whenever it fills up.
+class CsvWriter
+{
+public:
+
+    explicit CsvWriter(size_t buffer_size = 4 * 1024 * 1024);
+    ~CsvWriter();
+
+    bool Open(const std::string& path, int num_threads = 0);
+    // Flushes the buffer and closes the file, returns false if some data couldn't be written
+    bool Close();
+
+    void SetNumberFormat(const CsvNumberFormat& number_format);
+    const CsvNumberFormat& NumberFormat() const { return format; }
+
+    // Text kept in memory by a writer that isn't opened
+    const char* Data() const { return buffer.data(); }
+    size_t Size() const { return pos - buffer.data(); }
+    void Clear() { pos = buffer.data(); }
+
+    void Write(float value)
+    {
+        reserve(CSV_MAX_NUMBER_LENGTH);
+        pos = format_number(value, pos);
+    }
+    void Write(double value)
+    {
+        reserve(CSV_MAX_NUMBER_LENGTH);
+        pos = format_number(value, pos);
+    }
+    void Write(int value);
+    void Write(char c)
+    {
+        reserve(1);
+        *pos++ = c;
+    }
+    void Write(const char * str);
+    void Write(const char * text, size_t length);
+
+    // Appends the formatted value to out, returns the end of the written text.
+    // At least CSV_MAX_NUMBER_LENGTH bytes must be available.
+    char* format_number(float value, char * out) const;
+    char* format_number(double value, char * out) const;
+
+private:
+
+    CsvWriter(const CsvWriter&);
+    CsvWriter& operator=(const CsvWriter&);
+
+    void reserve(size_t count)
+    {
+        if (size_t(buffer_end - pos) < count)
+            flush(count);
+    }
+    // Writes the buffer to the file, or grows it to fit count more bytes if there is no file
+    void flush(size_t count = 0);
+
+    bool is_open() const { return fd >= 0 || gzip; }
+
+    int fd;
+    std::unique_ptr<GzipWriter> gzip;
+    bool failed;
+    CsvNumberFormat format;
+    std::vector<char> buffer;
+    char * pos;
+    char * buffer_end;
+};
+
+#endif // CSV_WRITER_H
@@ -0,0 +1,223 @@
+#include "gzip_file.h"
+#include "parallel.h"
+#include "stats.h"
+#include <zlib.h>
+#include <stdexcept>
+#include <algorithm>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+// Compressed bytes read from the file at once
+#define GZIP_INPUT_SIZE (1024 * 1024)
+// windowBits of zlib for the gzip format
+#define GZIP_WINDOW_BITS (15 + 16)
+
+bool is_gzip_path(const std::string& path)
+{
+    return path.size() >= 3 && path.compare(path.size() - 3, 3, ".gz") == 0;
+}
+
+GzipReader::GzipReader() : fd(-1), stream(NULL), end_of_file(false), member_end(true), compressed_bytes(0)
+{
+}
+
+GzipReader::~GzipReader()
+{
+    Close();
+}
+
+bool GzipReader::Open(const std::string& path)
+{
+    Close();
+    this->path = path;
+    fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+    z_stream * z = new z_stream;
+    memset(z, 0, sizeof(*z));
+    if (inflateInit2(z, GZIP_WINDOW_BITS) != Z_OK)
+    {
+        delete z;
+        ::close(fd);
+        fd = -1;
+        return false;
+    }
+    stream = z;
+    end_of_file = false;
+    member_end = true;
+    compressed_bytes = 0;
+    input.resize(GZIP_INPUT_SIZE);
+    rest.clear();
+    return true;
+}
+
+void GzipReader::Close()
+{
+    if (stream)
+    {
+        inflateEnd(static_cast<z_stream*>(stream));
+        delete static_cast<z_stream*>(stream);
+        stream = NULL;
+    }
+    if (fd >= 0)
+        ::close(fd);
+    fd = -1;
+}
+
+size_t GzipReader::Read(char * out, size_t size)
+{
+    z_stream * z = static_cast<z_stream*>(stream);
+    z->next_out = reinterpret_cast<Bytef*>(out);
+    z->avail_out = size;
+    while (z->avail_out > 0 && !end_of_file)
+    {
+        if (z->avail_in == 0)
+        {
+            ssize_t count = ::read(fd, input.data(), input.size());
+            if (count < 0 && errno == EINTR)
+                continue;
+            if (count < 0)
+                throw std::runtime_error("Error in reading gzip file " + path + ": " + strerror(errno));
+            if (count == 0)
+            {
+                // A file may end only between members
+                if (!member_end)
+                    throw std::runtime_error("Error in reading gzip file " + path + ": unexpected end of file");
+                end_of_file = true;
+                break;
+            }
+            compressed_bytes += count;
+            z->next_in = input.data();
+            z->avail_in = count;
+        }
+        int result = inflate(z, Z_NO_FLUSH);
+        member_end = false;
+        if (result == Z_STREAM_END)
+        {
+            // The next member, if any, continues the text
+            inflateReset(z);
+            member_end = true;
+        }
+        else if (result != Z_OK && result != Z_BUF_ERROR)
+        {
+            throw std::runtime_error("Error in reading gzip file " + path + ": " + (z->msg ? z->msg : "corrupted data"));
+        }
+    }
+    return size - z->avail_out;
+}
+
+bool GzipReader::ReadLines(std::vector<char>& text, size_t block_size)
+{
+    StatsTimer timer(STATS_GZIP);
+    text.swap(rest);
+    rest.clear();
+    bool more = true;
+    while (more)
+    {
+        // Decompressing about block_size more bytes
+        size_t filled = text.size();
+        text.resize(filled + std::max<size_t>(block_size, 1));
+        size_t count = 1;
+        while (filled < text.size() && count > 0)
+        {
+            count = Read(text.data() + filled, text.size() - filled);
+            filled += count;
+        }
+        text.resize(filled);
+        more = count > 0;
+        // The unfinished last line is kept for the next call, a block without
+        // any '\n' grows until the end of its line
+        const char * newline = static_cast<const char*>(memrchr(text.data(), '\n', text.size()));
+        if (newline && more)
+        {
+            rest.assign(newline + 1, static_cast<const char*>(text.data() + text.size()));
+            text.resize(newline + 1 - text.data());
+            more = false;
+        }
+    }
+    timer.Add(text.size(), 0);
+    return !text.empty();
+}
+
+GzipWriter::GzipWriter(int num_threads, int level) : fd(-1), num_threads(num_threads), level(level), failed(false)
+{
+}
+
+GzipWriter::~GzipWriter()
+{
+    Close();
+}
+
+bool GzipWriter::Open(const std::string& path)
+{
+    Close();
+    fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    failed = false;
+    return fd >= 0;
+}
+
+bool GzipWriter::Close()
+{
+    if (fd < 0)
+        return !failed;
+    if (::close(fd) != 0)
+        failed = true;
+    fd = -1;
+    return !failed;
+}
+
+size_t GzipWriter::ParallelSize() const
+{
+    return size_t(GZIP_BLOCK_SIZE) * ((num_threads > 0) ? num_threads : default_num_threads());
+}
+
+bool GzipWriter::Write(const char * data, size_t size)
+{
+    const size_t num_of_members = (size + GZIP_BLOCK_SIZE - 1) / GZIP_BLOCK_SIZE;
+    if (members.size() < num_of_members)
+        members.resize(num_of_members);
+    parallel_for(num_of_members, num_threads, [&](size_t i)
+    {
+        StatsTimer timer(STATS_GZIP, 0, 0);
+        const size_t begin = i * GZIP_BLOCK_SIZE;
+        const size_t count = std::min<size_t>(GZIP_BLOCK_SIZE, size - begin);
+        z_stream z;
+        memset(&z, 0, sizeof(z));
+        if (deflateInit2(&z, level, Z_DEFLATED, GZIP_WINDOW_BITS, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+            throw std::runtime_error("Error in gzip compression: out of memory");
+        std::vector<unsigned char>& member = members[i];
+        member.resize(deflateBound(&z, count));
+        z.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data + begin));
+        z.avail_in = count;
+        z.next_out = member.data();
+        z.avail_out = member.size();
+        int result = deflate(&z, Z_FINISH);
+        member.resize(member.size() - z.avail_out);
+        deflateEnd(&z);
+        if (result != Z_STREAM_END)
+            throw std::runtime_error("Error in gzip compression");
+        timer.Add(count, 0);
+    });
+    for (size_t i = 0; i < num_of_members && !failed; i++)
+    {
+        StatsTimer timer(STATS_WRITE, members[i].size(), 0);
+        const unsigned char * out = members[i].data();
+        size_t left = members[i].size();
+        while (left > 0 && !failed)
+        {
+            ssize_t count = ::write(fd, out, left);
+            if (count < 0 && errno == EINTR)
+                continue;
+            if (count <= 0)
+                failed = true;
+            else
+            {
+                out += count;
+                left -= count;
+            }
+        }
+    }
+    return !failed;
+}
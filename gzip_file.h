@@ -0,0 +1,88 @@
+#ifndef GZIP_FILE_H
+#define GZIP_FILE_H
+
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <stdint.h>
+
+// Text compressed by one member of GzipWriter
+#define GZIP_BLOCK_SIZE (1024 * 1024)
+
+// Whether path ends with ".gz"
+bool is_gzip_path(const std::string& path);
+
+// Reads a gzip file as one stream of text. Files of several members, as written
+// by GzipWriter or pigz, are read as their concatenation. Errors in the
+// compressed data are reported by std::runtime_error.
+class GzipReader
+{
+public:
+
+    GzipReader();
+    ~GzipReader();
+
+    bool Open(const std::string& path);
+    void Close();
+
+    // Decompresses up to size bytes into out, returns the number of bytes, 0 at the end of the file
+    size_t Read(char * out, size_t size);
+
+    // Replaces text with whole lines: the unfinished line left by the previous call followed by
+    // about block_size more bytes up to the end of a line; the last line of the file may lack '\n'.
+    // Returns false when there is no text left.
+    bool ReadLines(std::vector<char>& text, size_t block_size);
+
+    // Compressed bytes read so far
+    uint64_t CompressedBytes() const { return compressed_bytes; }
+
+private:
+
+    GzipReader(const GzipReader&);
+    GzipReader& operator=(const GzipReader&);
+
+    std::string path;
+    int fd;
+    // z_stream, kept out of the header
+    void * stream;
+    bool end_of_file;
+    // Whether the data read so far ends with a whole member
+    bool member_end;
+    uint64_t compressed_bytes;
+    std::vector<unsigned char> input;
+    std::vector<char> rest;
+};
+
+// Writes a gzip file as independent members of GZIP_BLOCK_SIZE bytes of text each
+// (like pigz --independent), so that the members of a Write are compressed
+// concurrently on num_threads threads (0 - one per hardware thread). Any gzip
+// reader reads the members back as one stream.
+class GzipWriter
+{
+public:
+
+    explicit GzipWriter(int num_threads = 0, int level = 6);
+    ~GzipWriter();
+
+    bool Open(const std::string& path);
+    // Returns false if some data couldn't be written
+    bool Close();
+
+    bool Write(const char * data, size_t size);
+
+    // Text that Write compresses at once on all the threads
+    size_t ParallelSize() const;
+
+private:
+
+    GzipWriter(const GzipWriter&);
+    GzipWriter& operator=(const GzipWriter&);
+
+    int fd;
+    int num_threads;
+    int level;
+    bool failed;
+    std::vector<std::vector<unsigned char> > members;
+};
+
+#endif // GZIP_FILE_H
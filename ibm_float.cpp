@@ -0,0 +1,231 @@
+#include "ibm_float.h"
+#include <math.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define IBM_FLOAT_X86
+#include <immintrin.h>
+#endif
+
+float ibm_to_ieee(uint32_t ibm)
+{
+    uint32_t fraction = ibm & 0x00ffffff;
+    int exponent = (ibm >> 24) & 0x7f;
+    // fraction * 2^-24 * 16^(exponent - 64), rounded to float once
+    float value = float(ldexp(double(fraction), 4 * exponent - 280));
+    return (ibm & 0x80000000) ? -value : value;
+}
+
+uint32_t ieee_to_ibm(float value)
+{
+    uint32_t sign = signbit(value) ? 0x80000000 : 0;
+    if (isnan(value) || isinf(value))
+        return sign | 0x7fffffff;
+    if (value == 0)
+        return sign;
+
+    int binary_exponent;
+    double mantissa = frexp(fabs(double(value)), &binary_exponent);
+    // value = mantissa * 2^binary_exponent = fraction * 16^exponent16, fraction in [1/16, 1)
+    int exponent16 = (binary_exponent + 3) >> 2;
+    double fraction = ldexp(mantissa, binary_exponent - 4 * exponent16);
+    uint32_t bits = uint32_t(nearbyint(ldexp(fraction, 24)));
+    if (bits == 0x01000000)
+    {
+        bits >>= 4;
+        exponent16++;
+    }
+    int exponent = exponent16 + 64;
+    if (exponent > 127)
+        return sign | 0x7fffffff;
+    if (exponent < 0)
+    {
+        // Denormalized IBM number, the fraction is truncated
+        int shift = -4 * exponent;
+        bits = (shift < 24) ? bits >> shift : 0;
+        exponent = 0;
+    }
+    return sign | (uint32_t(exponent) << 24) | bits;
+}
+
+static void decode_ibm_scalar(const void * src, float * dst, size_t count)
+{
+    const char * in = static_cast<const char*>(src);
+    for (size_t i = 0; i < count; i++)
+    {
+        uint32_t word;
+        memcpy(&word, in + 4 * i, 4);
+        dst[i] = ibm_to_ieee(__builtin_bswap32(word));
+    }
+}
+
+static void encode_ibm_scalar(const float * src, void * dst, size_t count)
+{
+    char * out = static_cast<char*>(dst);
+    for (size_t i = 0; i < count; i++)
+    {
+        uint32_t word = __builtin_bswap32(ieee_to_ibm(src[i]));
+        memcpy(out + 4 * i, &word, 4);
+    }
+}
+
+#ifdef IBM_FLOAT_X86
+
+static const char byte_reverse_mask[32] =
+{
+    3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+    3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12
+};
+
+// The fraction is converted to float exactly, then the IBM scale is added to
+// the float exponent. Blocks with results outside the normal float range
+// (rare tiny or huge values) go through the scalar reference.
+__attribute__((target("avx2")))
+static void decode_ibm_avx2(const void * src, float * dst, size_t count)
+{
+    const char * in = static_cast<const char*>(src);
+    const __m256i reverse = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(byte_reverse_mask));
+    const __m256i fraction_mask = _mm256_set1_epi32(0x00ffffff);
+    const __m256i sign_mask = _mm256_set1_epi32(0x80000000);
+    const __m256i exponent_mask = _mm256_set1_epi32(0x7f);
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i min_exponent = _mm256_set1_epi32(0);
+    const __m256i max_exponent = _mm256_set1_epi32(255);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        __m256i word = _mm256_shuffle_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + 4 * i)), reverse);
+        __m256i fraction = _mm256_and_si256(word, fraction_mask);
+        __m256i sign = _mm256_and_si256(word, sign_mask);
+        __m256i exponent = _mm256_and_si256(_mm256_srli_epi32(word, 24), exponent_mask);
+        __m256i bits = _mm256_castps_si256(_mm256_cvtepi32_ps(fraction));
+        // scale = 4 * exponent - 280 added to the biased float exponent
+        __m256i scale = _mm256_sub_epi32(_mm256_slli_epi32(exponent, 2), _mm256_set1_epi32(280));
+        __m256i result_exponent = _mm256_add_epi32(_mm256_srli_epi32(bits, 23), scale);
+        __m256i is_zero = _mm256_cmpeq_epi32(fraction, zero);
+        __m256i in_range = _mm256_and_si256(_mm256_cmpgt_epi32(result_exponent, min_exponent),
+                                            _mm256_cmpgt_epi32(max_exponent, result_exponent));
+        if (_mm256_movemask_epi8(_mm256_or_si256(in_range, is_zero)) != -1)
+        {
+            decode_ibm_scalar(in + 4 * i, dst + i, 8);
+            continue;
+        }
+        __m256i result = _mm256_add_epi32(bits, _mm256_slli_epi32(scale, 23));
+        result = _mm256_andnot_si256(is_zero, result);
+        result = _mm256_or_si256(result, sign);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), result);
+    }
+    decode_ibm_scalar(in + 4 * i, dst + i, count - i);
+}
+
+// A normal float m * 2^(e - 150), m with the hidden bit, always fits IBM:
+// t = e + 130 = 4 * exponent16 - shift with shift in [0, 3], the fraction is m >> shift
+// rounded to nearest even. Zeros, denormals, infinities and NaNs go through the scalar reference.
+__attribute__((target("avx2")))
+static void encode_ibm_avx2(const float * src, void * dst, size_t count)
+{
+    char * out = static_cast<char*>(dst);
+    const __m256i reverse = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(byte_reverse_mask));
+    const __m256i sign_mask = _mm256_set1_epi32(0x80000000);
+    const __m256i mantissa_mask = _mm256_set1_epi32(0x007fffff);
+    const __m256i hidden_bit = _mm256_set1_epi32(0x00800000);
+    const __m256i overflow_bit = _mm256_set1_epi32(0x01000000);
+    const __m256i one = _mm256_set1_epi32(1);
+    const __m256i three = _mm256_set1_epi32(3);
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i max_exponent = _mm256_set1_epi32(255);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        __m256i bits = _mm256_castps_si256(_mm256_loadu_ps(src + i));
+        __m256i sign = _mm256_and_si256(bits, sign_mask);
+        __m256i float_exponent = _mm256_and_si256(_mm256_srli_epi32(bits, 23), max_exponent);
+        __m256i special = _mm256_or_si256(_mm256_cmpeq_epi32(float_exponent, zero),
+                                          _mm256_cmpeq_epi32(float_exponent, max_exponent));
+        if (!_mm256_testz_si256(special, special))
+        {
+            encode_ibm_scalar(src + i, out + 4 * i, 8);
+            continue;
+        }
+        __m256i mantissa = _mm256_or_si256(_mm256_and_si256(bits, mantissa_mask), hidden_bit);
+        __m256i t = _mm256_add_epi32(float_exponent, _mm256_set1_epi32(130));
+        __m256i shift = _mm256_and_si256(_mm256_sub_epi32(zero, t), three);
+        __m256i exponent = _mm256_srli_epi32(_mm256_add_epi32(t, shift), 2);
+        // round half to even: add (half - 1 + lsb) before shifting, nothing if shift == 0
+        __m256i lsb = _mm256_and_si256(_mm256_srlv_epi32(mantissa, shift), one);
+        __m256i half = _mm256_srli_epi32(_mm256_sllv_epi32(one, shift), 1);
+        __m256i bias = _mm256_add_epi32(_mm256_sub_epi32(half, one), lsb);
+        bias = _mm256_andnot_si256(_mm256_cmpeq_epi32(shift, zero), bias);
+        __m256i fraction = _mm256_srlv_epi32(_mm256_add_epi32(mantissa, bias), shift);
+        __m256i carry = _mm256_cmpeq_epi32(fraction, overflow_bit);
+        fraction = _mm256_blendv_epi8(fraction, _mm256_srli_epi32(fraction, 4), carry);
+        exponent = _mm256_sub_epi32(exponent, carry);
+        __m256i result = _mm256_or_si256(_mm256_or_si256(sign, _mm256_slli_epi32(exponent, 24)), fraction);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + 4 * i), _mm256_shuffle_epi8(result, reverse));
+    }
+    encode_ibm_scalar(src + i, out + 4 * i, count - i);
+}
+
+static bool has_avx2()
+{
+    static const bool supported = (__builtin_cpu_init(), __builtin_cpu_supports("avx2"));
+    return supported;
+}
+
+#endif // IBM_FLOAT_X86
+
+void decode_ibm_big_endian(const void * src, float * dst, size_t count)
+{
+#ifdef IBM_FLOAT_X86
+    if (has_avx2())
+    {
+        decode_ibm_avx2(src, dst, count);
+        return;
+    }
+#endif
+    decode_ibm_scalar(src, dst, count);
+}
+
+void encode_ibm_big_endian(const float * src, void * dst, size_t count)
+{
+#ifdef IBM_FLOAT_X86
+    if (has_avx2())
+    {
+        encode_ibm_avx2(src, dst, count);
+        return;
+    }
+#endif
+    encode_ibm_scalar(src, dst, count);
+}
+
+size_t check_ibm_kernels()
+{
+    const size_t block = 4096;
+    uint32_t words[block];
+    float floats[block];
+    float decoded[block];
+    uint32_t encoded[block];
+    size_t mismatches = 0;
+    // Every sign and exponent with fractions spread over the whole range,
+    // then float bit patterns with a stride co-prime to 2 to hit all exponents and roundings
+    for (uint64_t pattern = 0; pattern < (uint64_t(1) << 32); pattern += block * 65521ull)
+    {
+        for (size_t k = 0; k < block; k++)
+        {
+            uint32_t bits = uint32_t(pattern + k * 65521ull + (k * k) % 977);
+            words[k] = __builtin_bswap32(bits);
+            memcpy(&floats[k], &bits, 4);
+        }
+        decode_ibm_big_endian(words, decoded, block);
+        encode_ibm_big_endian(floats, encoded, block);
+        for (size_t k = 0; k < block; k++)
+        {
+            float reference = ibm_to_ieee(__builtin_bswap32(words[k]));
+            if (memcmp(&reference, &decoded[k], 4) != 0)
+                mismatches++;
+            if (__builtin_bswap32(encoded[k]) != ieee_to_ibm(floats[k]))
+                mismatches++;
+        }
+    }
+    return mismatches;
+}
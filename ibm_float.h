@@ -0,0 +1,28 @@
+#ifndef IBM_FLOAT_H
+#define IBM_FLOAT_H
+
+#include <cstddef>
+#include <stdint.h>
+
+// IBM System/360 single precision floats (SEG-Y data sample format 1):
+// sign bit, 7-bit base-16 exponent biased by 64 and a 24-bit fraction,
+// value = (-1)^sign * 0.fraction * 16^(exponent - 64).
+
+// Scalar reference conversions of one native-order IBM word.
+// IBM -> IEEE is exact except for values below the float range, which are rounded.
+// IEEE -> IBM rounds the fraction to nearest even; infinities and NaNs become
+// the largest IBM magnitude.
+float ibm_to_ieee(uint32_t ibm);
+uint32_t ieee_to_ibm(float value);
+
+// Batch conversions between big-endian IBM words (as stored in SEG-Y files)
+// and native floats. AVX2 is used when the CPU supports it; the results are
+// bitwise equal to the scalar reference.
+void decode_ibm_big_endian(const void * src, float * dst, size_t count);
+void encode_ibm_big_endian(const float * src, void * dst, size_t count);
+
+// Compares the batch kernels with the scalar reference on a sweep of bit
+// patterns in both directions, returns the number of mismatches
+size_t check_ibm_kernels();
+
+#endif // IBM_FLOAT_H
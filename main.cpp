@@ -1,14 +1,70 @@
 #include <iostream>
 #include <algorithm>
 #include <stdio.h>
+#include <stdlib.h>
 #include <getopt.h>
 #include <string.h>
+#include <stdexcept>
 #include "seismogram.h"
+#include "conversion.h"
+#include "parallel.h"
+#include "stats.h"
+#include <chrono>
 
 #define MAX_NAME_LENGTH 200
 
 using namespace std;
 
+// Parses sizes like "512", "64K", "256M" or "2G" (bytes), returns 0 on error
+size_t parse_memory_size(const char * str)
+{
+    char * end;
+    double value = ::strtod(str, &end);
+    if (end == str || value <= 0)
+        return 0;
+    switch (*end)
+    {
+        case 'k': case 'K': value *= 1024.0; break;
+        case 'm': case 'M': value *= 1024.0 * 1024.0; break;
+        case 'g': case 'G': value *= 1024.0 * 1024.0 * 1024.0; break;
+        case '\0': break;
+        default: return 0;
+    }
+    return size_t(value);
+}
+
+// Parses ranges like "0.5:1.5", "0.5:" or ":1.5"; a missing bound keeps its value, returns false on error
+bool parse_range(const char * str, double& first, double& second)
+{
+    const char * colon = strchr(str, ':');
+    if (!colon)
+        return false;
+    char * end;
+    if (colon != str)
+    {
+        first = ::strtod(str, &end);
+        if (end != colon || first < 0)
+            return false;
+    }
+    if (colon[1] != '\0')
+    {
+        second = ::strtod(colon + 1, &end);
+        if (*end != '\0' || second < 0)
+            return false;
+    }
+    return true;
+}
+
+// Parses a range of header values like parse_range, the bounds are whole numbers that fit 32 bits
+bool parse_header_range(const char * str, uint32& first, uint32& second)
+{
+    double low = first, high = second;
+    if (!parse_range(str, low, high) || low != uint32(low) || high != uint32(high) || high < low)
+        return false;
+    first = low;
+    second = high;
+    return true;
+}
 
 int main(int argc, char ** argv)
 {
@@ -17,11 +73,23 @@ int main(int argc, char ** argv)
     char csv_file[MAX_NAME_LENGTH] = "csv_file";
     char segy_file[MAX_NAME_LENGTH] = "segy_file";
     float interpolation_coef = 1.0;
+    size_t max_memory = 256 * 1024 * 1024;
+    int segy_format = 5;
+    int num_threads = 0;
+    CsvNumberFormat csv_format;
+    const char * batch = NULL;
+    ResamplingType resampling = LINEAR_RESAMPLING;
+    SegYWindow segy_window;
+    SegYReadOptions segy_read_options;
+    SegYTraceQuery segy_query;
+    const char * stats_path = NULL;
+    double progress_period = 0.0;
+    bool csv_gzip = false;
 
     int c;
     opterr = 0;
 
-    const char    * short_opt = "hc:d:f:s:i:";
+    const char    * short_opt = "hc:d:f:s:i:r:m:F:t:p:xb:T:w:S:P:zR:B:I:X:Y:O:";
     struct option   long_opt[] =
     {
         {"help",          no_argument,       NULL, 'h'},
@@ -30,6 +98,24 @@ int main(int argc, char ** argv)
         {"csvfile",       required_argument, NULL, 'f'},
         {"segyfile",      required_argument, NULL, 's'},
         {"interpolation_coef",      required_argument, NULL, 'i'},
+        {"resampling",    required_argument, NULL, 'r'},
+        {"max_memory",    required_argument, NULL, 'm'},
+        {"segy_format",   required_argument, NULL, 'F'},
+        {"threads",       required_argument, NULL, 't'},
+        {"precision",     required_argument, NULL, 'p'},
+        {"fixed",         no_argument,       NULL, 'x'},
+        {"batch",         required_argument, NULL, 'b'},
+        {"traces",        required_argument, NULL, 'T'},
+        {"time_window",   required_argument, NULL, 'w'},
+        {"stats",         required_argument, NULL, 'S'},
+        {"progress",      required_argument, NULL, 'P'},
+        {"gzip",          no_argument,       NULL, 'z'},
+        {"read_ahead",    required_argument, NULL, 'R'},
+        {"read_block",    required_argument, NULL, 'B'},
+        {"io_threads",    required_argument, NULL, 'I'},
+        {"receiver_x",    required_argument, NULL, 'X'},
+        {"receiver_y",    required_argument, NULL, 'Y'},
+        {"offset",        required_argument, NULL, 'O'},
         {NULL,            0,                 NULL, 0  }
     };
 
@@ -68,14 +154,204 @@ int main(int argc, char ** argv)
             printf("you entered \"%s\"\n", optarg);
             break;
 
+            case 'r':
+            if (!strcmp(optarg, "linear"))
+                resampling = LINEAR_RESAMPLING;
+            else if (!strcmp(optarg, "sinc"))
+                resampling = SINC_RESAMPLING;
+            else
+            {
+                fprintf(stderr, "Invalid value for option resampling (should be equal to \"linear\" or \"sinc\", but equal to %s)\n", optarg);
+                fprintf(stderr, "Try `%s --help' for more information.\n", argv[0]);
+                return(-2);
+            }
+            printf("you entered \"%s\"\n", optarg);
+            break;
+
+            case 'm':
+            max_memory = parse_memory_size(optarg);
+            printf("you entered \"%s\"\n", optarg);
+            if (max_memory == 0)
+            {
+                fprintf(stderr, "Invalid value for option max_memory (%s)\n", optarg);
+                fprintf(stderr, "Try `%s --help' for more information.\n", argv[0]);
+                return(-2);
+            }
+            break;
+
+            case 'F':
+            if (!strcmp(optarg, "ieee"))
+                segy_format = 5;
+            else if (!strcmp(optarg, "ibm"))
+                segy_format = 1;
+            else
+            {
+                fprintf(stderr, "Invalid value for option segy_format (should be equal to \"ieee\" or \"ibm\", but equal to %s)\n", optarg);
+                fprintf(stderr, "Try `%s --help' for more information.\n", argv[0]);
+                return(-2);
+            }
+            printf("you entered \"%s\"\n", optarg);
+            break;
+
+            case 't':
+            num_threads = ::atoi(optarg);
+            printf("you entered \"%s\"\n", optarg);
+            break;
+
+            case 'R':
+            segy_read_options.read_ahead = ::atoi(optarg);
+            printf("you entered \"%s\"\n", optarg);
+            if (segy_read_options.read_ahead < 0)
+            {
+                fprintf(stderr, "Invalid value for option read_ahead (should be 0 or more blocks, but equal to %s)\n", optarg);
+                fprintf(stderr, "Try `%s --help' for more information.\n", argv[0]);
+                return(-2);
+            }
+            break;
+
+            case 'B':
+            segy_read_options.block_size = parse_memory_size(optarg);
+            printf("you entered \"%s\"\n", optarg);
+            if (segy_read_options.block_size == 0)
+            {
+                fprintf(stderr, "Invalid value for option read_block (%s)\n", optarg);
+                fprintf(stderr, "Try `%s --help' for more information.\n", argv[0]);
+                return(-2);
+            }
+            break;
+
+            case 'I':
+            segy_read_options.io_threads = ::atoi(optarg);
+            printf("you entered \"%s\"\n", optarg);
+            if (segy_read_options.io_threads < 1)
+            {
+                fprintf(stderr, "Invalid value for option io_threads (should be 1 or more, but equal to %s)\n", optarg);
+                fprintf(stderr, "Try `%s --help' for more information.\n", argv[0]);
+                return(-2);
+            }
+            break;
+
+            case 'X':
+            case 'Y':
+            {
+                uint32& low = (c == 'X') ? segy_query.receiver_x_min : segy_query.receiver_y_min;
+                uint32& high = (c == 'X') ? segy_query.receiver_x_max : segy_query.receiver_y_max;
+                printf("you entered \"%s\"\n", optarg);
+                if (!parse_header_range(optarg, low, high))
+                {
+                    fprintf(stderr, "Invalid value for option %s (should be like \"min:max\", but equal to %s)\n",
+                            (c == 'X') ? "receiver_x" : "receiver_y", optarg);
+                    fprintf(stderr, "Try `%s --help' for more information.\n", argv[0]);
+                    return(-2);
+                }
+                segy_query.by_receiver = true;
+            }
+            break;
+
+            case 'O':
+            printf("you entered \"%s\"\n", optarg);
+            if (!parse_header_range(optarg, segy_query.min_offset, segy_query.max_offset))
+            {
+                fprintf(stderr, "Invalid value for option offset (should be like \"min:max\", but equal to %s)\n", optarg);
+                fprintf(stderr, "Try `%s --help' for more information.\n", argv[0]);
+                return(-2);
+            }
+            segy_query.by_offset = true;
+            break;
+
+            case 'p':
+            csv_format.precision = ::atoi(optarg);
+            printf("you entered \"%s\"\n", optarg);
+            if (csv_format.precision < 0 || csv_format.precision > CSV_MAX_PRECISION)
+            {
+                fprintf(stderr, "Invalid value for option precision (should be from 0 to %d, but equal to %s)\n", CSV_MAX_PRECISION, optarg);
+                fprintf(stderr, "Try `%s --help' for more information.\n", argv[0]);
+                return(-2);
+            }
+            break;
+
+            case 'x':
+            csv_format.fixed = true;
+            break;
+
+            case 'z':
+            csv_gzip = true;
+            break;
+
+            case 'b':
+            batch = optarg;
+            printf("you entered \"%s\"\n", optarg);
+            break;
+
+            case 'T':
+            {
+                double first = 0.0, count = 0.0;
+                printf("you entered \"%s\"\n", optarg);
+                if (!parse_range(optarg, first, count) || first != IndexType(first) || count != IndexType(count))
+                {
+                    fprintf(stderr, "Invalid value for option traces (should be like \"first:count\", but equal to %s)\n", optarg);
+                    fprintf(stderr, "Try `%s --help' for more information.\n", argv[0]);
+                    return(-2);
+                }
+                segy_window.first_trace = first;
+                segy_window.num_traces = count;
+            }
+            break;
+
+            case 'w':
+            printf("you entered \"%s\"\n", optarg);
+            if (!parse_range(optarg, segy_window.start_time, segy_window.end_time) ||
+                (segy_window.end_time >= 0.0 && segy_window.end_time < segy_window.start_time))
+            {
+                fprintf(stderr, "Invalid value for option time_window (should be like \"start:end\" in seconds, but equal to %s)\n", optarg);
+                fprintf(stderr, "Try `%s --help' for more information.\n", argv[0]);
+                return(-2);
+            }
+            break;
+
+            case 'S':
+            stats_path = optarg;
+            printf("you entered \"%s\"\n", optarg);
+            break;
+
+            case 'P':
+            progress_period = ::atof(optarg);
+            printf("you entered \"%s\"\n", optarg);
+            if (progress_period <= 0.0)
+            {
+                fprintf(stderr, "Invalid value for option progress (should be a positive number of seconds, but equal to %s)\n", optarg);
+                fprintf(stderr, "Try `%s --help' for more information.\n", argv[0]);
+                return(-2);
+            }
+            break;
+
             case 'h':
             printf("Usage: %s [OPTIONS]\n", argv[0]);
             printf("  Option                  |  Description                                       | Default \n");
-            printf("  -c, --convertion          \"tosegy\" or \"tocsv\"                                  tosegy\n");
+            printf("  -c, --convertion          \"tosegy\", \"tocsv\", \"tonpy\", \"fromnpy\" or \"index\"     tosegy\n");
             printf("  -d, --dims                number of dimmensions: 2 or 3                        2\n");
             printf("  -s, --segyfile            .segy file (without _x.segy at the end)              segy_file\n");
             printf("  -f, --csvfile             .csv file (without .csv extension at the end)        csv_file\n");
             printf("  -i, --interpolation_coef  time interpolation coefficient                       1.0\n");
+            printf("  -r, --resampling          \"linear\" or \"sinc\" (band-limited, no aliasing)       linear\n");
+            printf("                            (sinc needs equidistant input times)\n");
+            printf("  -m, --max_memory          memory for buffered rows, e.g. 512M or 2G            256M\n");
+            printf("  -F, --segy_format         sample format of created .segy: \"ieee\" or \"ibm\"      ieee\n");
+            printf("  -t, --threads             number of threads, 0 - one per hardware thread       0\n");
+            printf("  -p, --precision           significant digits in .csv, 0 - shortest exact       6\n");
+            printf("  -x, --fixed               precision is the number of digits after the point\n");
+            printf("  -z, --gzip                tocsv writes .csv.gz (tosegy reads it when no .csv)\n");
+            printf("  -b, --batch               manifest of shots or a pattern like \"shots/*_x.segy\"\n");
+            printf("  -T, --traces              traces read by tocsv/tonpy: first:count (from 0)     all\n");
+            printf("  -w, --time_window         samples read by tocsv/tonpy: start:end seconds       all\n");
+            printf("  -X, --receiver_x          tocsv/tonpy read traces with receiver x in min:max   all\n");
+            printf("  -Y, --receiver_y          tocsv/tonpy read traces with receiver y in min:max   all\n");
+            printf("  -O, --offset              tocsv/tonpy read traces with source offset in min:max all\n");
+            printf("  -R, --read_ahead          .segy blocks read ahead with pread, 0 - memory map   0\n");
+            printf("  -B, --read_block          size of the blocks read ahead, e.g. 4M               4M\n");
+            printf("  -I, --io_threads          threads reading blocks ahead                         2\n");
+            printf("  -S, --stats               write time per stage and throughput as JSON (- stdout)\n");
+            printf("  -P, --progress            print progress and ETA to stderr every N seconds\n");
             printf("  -h, --help                print this help and exit\n");
             printf("Example: %s --segyfile seismo --csvfile input\n", argv[0]);
             printf("\n");
@@ -98,83 +374,80 @@ int main(int argc, char ** argv)
         fprintf(stderr, "Try `%s --help' for more information.\n", argv[0]);
         return(-2);
     }
-    if (strcmp(convertion,"tosegy") != 0 && strcmp(convertion,"tocsv") != 0 )
+    if (strcmp(convertion,"tosegy") != 0 && strcmp(convertion,"tocsv") != 0 &&
+        strcmp(convertion,"tonpy") != 0 && strcmp(convertion,"fromnpy") != 0 && strcmp(convertion,"index") != 0)
     {
-        fprintf(stderr, "Invalid value for option convertion (should be equal to \"tosegy\" or \"tocsv\", but equal to %s)\n", convertion);
+        fprintf(stderr, "Invalid value for option convertion (should be equal to \"tosegy\", \"tocsv\", \"tonpy\", \"fromnpy\" or \"index\", but equal to %s)\n", convertion);
         fprintf(stderr, "Try `%s --help' for more information.\n", argv[0]);
         return(-2);
     }
 
-    if (dims == 2)
+    if (!segy_query.IsEmpty() && !segy_window.IsWhole())
     {
-        char * segy_file_x = strdup(segy_file);
-        strcat(segy_file_x, "_x.segy");
-        char * segy_file_y = strdup(segy_file);
-        strcat(segy_file_y, "_y.segy");
-        typedef CombinedSeismogramm<float, 2>::Elastic SeismoElastic;
-        CombinedSeismogramm < float, 2 > s = CombinedSeismogramm < float, 2 >(interpolation_coef);
-        s.AddComponent(segy_file_x, new VxGetter<SeismoElastic, 2>());
-        s.AddComponent(segy_file_y, new VyGetter<SeismoElastic, 2>());
-
-        std::vector<std::string> csv_files;
-        csv_files.push_back(csv_file);
-
-
-        std::vector<std::string> segy_files;
-        segy_files.push_back(segy_file_x);
-        segy_files.push_back(segy_file_y);
+        fprintf(stderr, "Options receiver_x, receiver_y and offset can't be combined with traces and time_window\n");
+        fprintf(stderr, "Try `%s --help' for more information.\n", argv[0]);
+        return(-2);
+    }
 
-        if (!strcmp(convertion,"tosegy"))
+    ConversionOptions options;
+    const char * convertions[] = { "tosegy", "tocsv", "tonpy", "fromnpy", "index" };
+    for (int i = 0; i < 5; i++)
+        if (!strcmp(convertion, convertions[i]))
+            options.type = ConversionType(i);
+    options.dims = dims;
+    options.interpolation_coef = interpolation_coef;
+    options.resampling = resampling;
+    options.segy_format = segy_format;
+    options.csv_format = csv_format;
+    options.max_memory = max_memory;
+    options.num_threads = num_threads;
+    options.segy_window = segy_window;
+    options.csv_gzip = csv_gzip;
+    options.segy_read_options = segy_read_options;
+    options.segy_query = segy_query;
+
+    int status = 0;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    uint64 input_bytes = 0;
+    stats_enable(stats_path != NULL || progress_period > 0.0);
+    try
+    {
+        std::vector<ConversionShot> shots;
+        if (batch)
+            shots = read_batch_shots(batch, options);
+        else
+            shots.push_back(ConversionShot(segy_file, csv_file));
+        for (size_t i = 0; i < shots.size(); i++)
+            input_bytes += shot_input_size(shots[i], options);
+
+        std::unique_ptr<StatsProgress> progress;
+        if (progress_period > 0.0)
+            progress.reset(new StatsProgress(progress_period, input_bytes));
+        if (batch)
         {
-            s.Load(CSV, csv_files);
-            s.Save(SEG_Y, segy_files);
+            if (run_batch(shots, options) > 0)
+                status = 1;
         }
-        else if (!strcmp(convertion,"tocsv"))
+        else
         {
-            s.Load(SEG_Y, segy_files);
-            s.Save(CSV, csv_files);
+            convert_shot(shots[0], options);
         }
-        free(segy_file_x);
-        free(segy_file_y);
     }
-    else if (dims == 3)
+    catch (const std::exception& e)
     {
-        char * segy_file_x = strdup(segy_file);
-        strcat(segy_file_x, "_x.segy");
-        char * segy_file_y = strdup(segy_file);
-        strcat(segy_file_y, "_y.segy");
-        char * segy_file_z = strdup(segy_file);
-        strcat(segy_file_z, "_z.segy");
-        typedef CombinedSeismogramm<float, 3>::Elastic SeismoElastic;
-        CombinedSeismogramm < float, 3 > s = CombinedSeismogramm < float, 3 >(interpolation_coef);
-        s.AddComponent(segy_file_x, new VxGetter<SeismoElastic, 3>());
-        s.AddComponent(segy_file_y, new VyGetter<SeismoElastic, 3>());
-        s.AddComponent(segy_file_z, new VzGetter<SeismoElastic, 3>());
-
-        std::vector<std::string> csv_files;
-        csv_files.push_back(csv_file);
-
-
-        std::vector<std::string> segy_files;
-        segy_files.push_back(segy_file_x);
-        segy_files.push_back(segy_file_y);
-        segy_files.push_back(segy_file_z);
-
-        if (!strcmp(convertion,"tosegy"))
-        {
-            s.Load(CSV, csv_files);
-            s.Save(SEG_Y, segy_files);
-        }
-        else if (!strcmp(convertion,"tocsv"))
+        std::cout << e.what() << std::endl;
+        status = 1;
+    }
+    if (stats_path)
+    {
+        double wall_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (!write_stats_json(stats_path, wall_seconds, (num_threads > 0) ? num_threads : default_num_threads(), input_bytes))
         {
-            s.Load(SEG_Y, segy_files);
-            s.Save(CSV, csv_files);
+            fprintf(stderr, "Error in writing stats file: %s\n", stats_path);
+            status = 1;
         }
-        free(segy_file_x);
-        free(segy_file_y);
-        free(segy_file_z);
     }
-    return 0;
+    return status;
 }
 
 
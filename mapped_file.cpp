@@ -0,0 +1,54 @@
+#include "mapped_file.h"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+MappedFile::MappedFile() : mapped_data(0), mapped_size(0)
+{
+}
+
+MappedFile::~MappedFile()
+{
+    Close();
+}
+
+bool MappedFile::Open(const std::string& path)
+{
+    Close();
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat st;
+    if (::fstat(fd, &st) != 0 || st.st_size <= 0)
+    {
+        ::close(fd);
+        return false;
+    }
+
+    void * ptr = ::mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    // The mapping keeps its own reference to the file
+    ::close(fd);
+    if (ptr == MAP_FAILED)
+        return false;
+
+    ::madvise(ptr, st.st_size, MADV_SEQUENTIAL);
+    mapped_data = static_cast<const char*>(ptr);
+    mapped_size = st.st_size;
+    return true;
+}
+
+void MappedFile::Close()
+{
+    if (mapped_data)
+        ::munmap(const_cast<char*>(mapped_data), mapped_size);
+    mapped_data = 0;
+    mapped_size = 0;
+}
+
+void MappedFile::Release()
+{
+    if (mapped_data)
+        ::madvise(const_cast<char*>(mapped_data), mapped_size, MADV_DONTNEED);
+}
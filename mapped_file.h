@@ -0,0 +1,33 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <string>
+#include <cstddef>
+
+// Read-only memory mapping of a whole file.
+class MappedFile
+{
+public:
+
+    MappedFile();
+    ~MappedFile();
+
+    bool Open(const std::string& path);
+    void Close();
+    // Drops the resident pages of the mapping, they are re-read on the next access
+    void Release();
+
+    bool IsOpen() const { return mapped_data != 0; }
+    const char* Data() const { return mapped_data; }
+    size_t Size() const { return mapped_size; }
+
+private:
+
+    MappedFile(const MappedFile&);
+    MappedFile& operator=(const MappedFile&);
+
+    const char* mapped_data;
+    size_t mapped_size;
+};
+
+#endif // MAPPED_FILE_H
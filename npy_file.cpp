@@ -0,0 +1,216 @@
+#include "npy_file.h"
+#include "stats.h"
+#include <sstream>
+#include <stdexcept>
+#include <algorithm>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <limits.h>
+#include <sys/uio.h>
+
+#define NPY_MAGIC "\x93NUMPY"
+#define NPY_MAGIC_SIZE 6
+// The header is padded so that the data starts at a multiple of this
+#define NPY_HEADER_ALIGNMENT 64
+
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+
+std::string npy_header(const std::string& descr, const std::vector<size_t>& shape)
+{
+    std::ostringstream dict;
+    dict << "{'descr': '" << descr << "', 'fortran_order': False, 'shape': (";
+    for (size_t i = 0; i < shape.size(); i++)
+        dict << shape[i] << ((shape.size() == 1 || i + 1 < shape.size()) ? "," : "") << ((i + 1 < shape.size()) ? " " : "");
+    dict << "), }";
+    std::string text = dict.str();
+    size_t prefix = NPY_MAGIC_SIZE + 2 + 2;
+    size_t total = (prefix + text.size() + 1 + NPY_HEADER_ALIGNMENT - 1) / NPY_HEADER_ALIGNMENT * NPY_HEADER_ALIGNMENT;
+    text.append(total - prefix - text.size() - 1, ' ');
+    text.push_back('\n');
+
+    std::string header(NPY_MAGIC, NPY_MAGIC_SIZE);
+    header.push_back(1);
+    header.push_back(0);
+    header.push_back(char(text.size() & 0xff));
+    header.push_back(char(text.size() >> 8));
+    return header + text;
+}
+
+// Writes all the pieces with as few system calls as possible
+void write_pieces(int fd, std::vector<iovec>& pieces)
+{
+    StatsTimer timer(STATS_WRITE);
+    for (size_t i = 0; i < pieces.size(); i++)
+        timer.Add(pieces[i].iov_len, 0);
+    size_t first = 0;
+    while (first < pieces.size())
+    {
+        int count = std::min<size_t>(pieces.size() - first, IOV_MAX);
+        ssize_t written = ::writev(fd, &pieces[first], count);
+        if (written < 0 && errno == EINTR)
+            continue;
+        if (written <= 0)
+            throw std::runtime_error(strerror(errno));
+        // Skipping what has been written, a piece may be written partially
+        while (first < pieces.size() && size_t(written) >= pieces[first].iov_len)
+        {
+            written -= pieces[first].iov_len;
+            first++;
+        }
+        if (written > 0)
+        {
+            pieces[first].iov_base = static_cast<char*>(pieces[first].iov_base) + written;
+            pieces[first].iov_len -= written;
+        }
+    }
+}
+
+void write_npy(const std::string& path, const std::string& descr, const std::vector<size_t>& shape,
+               const std::vector<NpyPiece>& pieces)
+{
+    int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        throw std::runtime_error("Error in writing NPY file: " + path);
+    std::string header = npy_header(descr, shape);
+    std::vector<iovec> iov;
+    iov.reserve(pieces.size() + 1);
+    iovec header_piece = { const_cast<char*>(header.data()), header.size() };
+    iov.push_back(header_piece);
+    for (size_t i = 0; i < pieces.size(); i++)
+    {
+        iovec piece = { const_cast<void*>(pieces[i].data), pieces[i].size };
+        if (piece.iov_len > 0)
+            iov.push_back(piece);
+    }
+    try
+    {
+        write_pieces(fd, iov);
+    }
+    catch (const std::exception& e)
+    {
+        ::close(fd);
+        throw std::runtime_error("Error in writing NPY file " + path + ": " + e.what());
+    }
+    if (::close(fd) != 0)
+        throw std::runtime_error("Error in writing NPY file: " + path);
+}
+
+// Text after "'key':" in the header dictionary, empty if there is no such key
+std::string npy_header_value(const std::string& dict, const char * key)
+{
+    size_t pos = dict.find(std::string("'") + key + "'");
+    if (pos == std::string::npos)
+        return std::string();
+    size_t begin = dict.find(':', pos);
+    begin = (begin == std::string::npos) ? begin : dict.find_first_not_of(' ', begin + 1);
+    if (begin == std::string::npos)
+        return std::string();
+    size_t end = (dict[begin] == '(') ? dict.find(')', begin) : dict.find_first_of(",}", begin);
+    if (end == std::string::npos)
+        return std::string();
+    return dict.substr(begin, end - begin + (dict[begin] == '(' ? 1 : 0));
+}
+
+bool NpyFile::Open(const std::string& path)
+{
+    Close();
+    if (!file.Open(path))
+        return false;
+    const char * raw = file.Data();
+    size_t header_size = 0;
+    size_t prefix = NPY_MAGIC_SIZE + 2;
+    if (file.Size() >= prefix + 2 && memcmp(raw, NPY_MAGIC, NPY_MAGIC_SIZE) == 0)
+    {
+        const unsigned char * length = reinterpret_cast<const unsigned char*>(raw + prefix);
+        if (raw[NPY_MAGIC_SIZE] == 1)
+        {
+            header_size = length[0] | (length[1] << 8);
+            prefix += 2;
+        }
+        else if (file.Size() >= prefix + 4)
+        {
+            header_size = length[0] | (length[1] << 8) | (length[2] << 16) | (size_t(length[3]) << 24);
+            prefix += 4;
+        }
+    }
+    if (header_size == 0 || prefix + header_size > file.Size())
+        throw std::runtime_error("Error in reading NPY file " + path + ": not an .npy file");
+    std::string dict(raw + prefix, header_size);
+    data_offset = prefix + header_size;
+
+    std::string descr_value = npy_header_value(dict, "descr");
+    size_t quote = descr_value.find_first_of("'\"");
+    descr = (quote == std::string::npos) ? std::string() :
+            descr_value.substr(quote + 1, descr_value.find(descr_value[quote], quote + 1) - quote - 1);
+    item_size = (descr.size() >= 3) ? ::atoi(descr.c_str() + 2) : 0;
+    if (item_size == 0)
+        throw std::runtime_error("Error in reading NPY file " + path + ": unsupported element type '" + descr + "'");
+    if (npy_header_value(dict, "fortran_order").find("True") != std::string::npos)
+        throw std::runtime_error("Error in reading NPY file " + path + ": Fortran order isn't supported");
+
+    std::string shape_value = npy_header_value(dict, "shape");
+    shape.clear();
+    const char * pos = shape_value.c_str();
+    while ((pos = strpbrk(pos, "0123456789")) != 0)
+    {
+        char * end;
+        shape.push_back(::strtoull(pos, &end, 10));
+        pos = end;
+    }
+    if (data_offset + NumElements() * item_size > file.Size())
+        throw std::runtime_error("Error in reading NPY file " + path + ": the file is truncated");
+    return true;
+}
+
+size_t NpyFile::NumElements() const
+{
+    size_t count = 1;
+    for (size_t i = 0; i < shape.size(); i++)
+        count *= shape[i];
+    return count;
+}
+
+template <typename T>
+void append_values(const char * data, size_t count, bool swap, std::vector<double>& values)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        char raw[sizeof(T)];
+        memcpy(raw, data + i * sizeof(T), sizeof(T));
+        if (swap)
+            std::reverse(raw, raw + sizeof(T));
+        T value;
+        memcpy(&value, raw, sizeof(T));
+        values.push_back(double(value));
+    }
+}
+
+std::vector<double> NpyFile::ValuesAsDouble() const
+{
+    std::vector<double> values;
+    values.reserve(NumElements());
+    const char native = NPY_NATIVE_FLOAT32[0];
+    bool swap = (descr[0] == '<' || descr[0] == '>') && descr[0] != native;
+    std::string type = descr.substr(1);
+    if (type == "f4")
+        append_values<float>(Data(), NumElements(), swap, values);
+    else if (type == "f8")
+        append_values<double>(Data(), NumElements(), swap, values);
+    else if (type == "i4")
+        append_values<int32_t>(Data(), NumElements(), swap, values);
+    else if (type == "u4")
+        append_values<uint32_t>(Data(), NumElements(), swap, values);
+    else if (type == "i8")
+        append_values<int64_t>(Data(), NumElements(), swap, values);
+    else if (type == "u8")
+        append_values<uint64_t>(Data(), NumElements(), swap, values);
+    else
+        throw std::runtime_error("Unsupported NPY element type '" + descr + "'");
+    return values;
+}
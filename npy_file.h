@@ -0,0 +1,66 @@
+#ifndef NPY_FILE_H
+#define NPY_FILE_H
+
+#include <string>
+#include <vector>
+#include <cstddef>
+#include "mapped_file.h"
+
+// NumPy .npy files (format version 1.0): a short text header describing
+// the element type and shape followed by the raw elements in C order.
+
+// Element types in the byte order of this machine
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define NPY_NATIVE_FLOAT32 ">f4"
+#define NPY_NATIVE_FLOAT64 ">f8"
+#define NPY_NATIVE_UINT32 ">u4"
+#else
+#define NPY_NATIVE_FLOAT32 "<f4"
+#define NPY_NATIVE_FLOAT64 "<f8"
+#define NPY_NATIVE_UINT32 "<u4"
+#endif
+
+// Consecutive bytes of the array data
+struct NpyPiece
+{
+    const void * data;
+    size_t size;
+
+    NpyPiece(const void * data, size_t size) : data(data), size(size) {}
+};
+
+// Writes an array of the given element type (e.g. NPY_NATIVE_FLOAT32) and shape.
+// The data is gathered from the pieces straight from where they are stored.
+// Throws std::runtime_error on failure.
+void write_npy(const std::string& path, const std::string& descr, const std::vector<size_t>& shape,
+               const std::vector<NpyPiece>& pieces);
+
+// Memory mapped .npy file
+class NpyFile
+{
+public:
+
+    // Returns false if the file can't be opened, throws std::runtime_error if it isn't a valid .npy file
+    bool Open(const std::string& path);
+    void Close() { file.Close(); }
+
+    const std::string& Descr() const { return descr; }
+    const std::vector<size_t>& Shape() const { return shape; }
+    size_t NumElements() const;
+    // Bytes per element
+    size_t ItemSize() const { return item_size; }
+    const char* Data() const { return file.Data() + data_offset; }
+
+    // Converts the elements of a numeric type to doubles
+    std::vector<double> ValuesAsDouble() const;
+
+private:
+
+    MappedFile file;
+    std::string descr;
+    std::vector<size_t> shape;
+    size_t item_size;
+    size_t data_offset;
+};
+
+#endif // NPY_FILE_H
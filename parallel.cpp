@@ -0,0 +1,141 @@
+#include "parallel.h"
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <exception>
+#include <mutex>
+#include <memory>
+
+int default_num_threads()
+{
+    int count = std::thread::hardware_concurrency();
+    return count > 0 ? count : 1;
+}
+
+void parallel_for(size_t count, int num_threads, const std::function<void(size_t)>& fn)
+{
+    if (num_threads <= 0)
+        num_threads = default_num_threads();
+    if (size_t(num_threads) > count)
+        num_threads = count;
+
+    std::vector<std::exception_ptr> errors(count);
+    std::atomic<size_t> next(0);
+    auto worker = [&]()
+    {
+        for (size_t i = next++; i < count; i = next++)
+        {
+            try
+            {
+                fn(i);
+            }
+            catch (...)
+            {
+                errors[i] = std::current_exception();
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (int t = 1; t < num_threads; t++)
+        threads.push_back(std::thread(worker));
+    worker();
+    for (size_t t = 0; t < threads.size(); t++)
+        threads[t].join();
+
+    for (size_t i = 0; i < count; i++)
+        if (errors[i])
+            std::rethrow_exception(errors[i]);
+}
+
+// Indices [begin, end) still owned by one thread
+struct stealing_share
+{
+    std::mutex lock;
+    size_t begin;
+    size_t end;
+};
+
+void parallel_for_stealing(size_t count, int num_threads, const std::function<void(size_t)>& fn)
+{
+    if (num_threads <= 0)
+        num_threads = default_num_threads();
+    if (size_t(num_threads) > count)
+        num_threads = count;
+    if (num_threads <= 1)
+    {
+        parallel_for(count, 1, fn);
+        return;
+    }
+
+    std::vector<std::unique_ptr<stealing_share> > shares(num_threads);
+    for (int t = 0; t < num_threads; t++)
+    {
+        shares[t].reset(new stealing_share);
+        shares[t]->begin = count * t / num_threads;
+        shares[t]->end = count * (t + 1) / num_threads;
+    }
+
+    std::vector<std::exception_ptr> errors(count);
+    // Returns false when no index is left anywhere
+    auto take = [&](int self, size_t& index) -> bool
+    {
+        {
+            std::lock_guard<std::mutex> guard(shares[self]->lock);
+            if (shares[self]->begin < shares[self]->end)
+            {
+                index = shares[self]->begin++;
+                return true;
+            }
+        }
+        while (true)
+        {
+            int victim = -1;
+            size_t most = 0;
+            for (int t = 0; t < num_threads; t++)
+            {
+                std::lock_guard<std::mutex> guard(shares[t]->lock);
+                if (shares[t]->end - shares[t]->begin > most)
+                {
+                    most = shares[t]->end - shares[t]->begin;
+                    victim = t;
+                }
+            }
+            if (victim < 0)
+                return false;
+            std::lock_guard<std::mutex> guard(shares[victim]->lock);
+            // The share may have been drained since it was looked at
+            if (shares[victim]->begin < shares[victim]->end)
+            {
+                index = --shares[victim]->end;
+                return true;
+            }
+        }
+    };
+    auto worker = [&](int self)
+    {
+        size_t i;
+        while (take(self, i))
+        {
+            try
+            {
+                fn(i);
+            }
+            catch (...)
+            {
+                errors[i] = std::current_exception();
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (int t = 1; t < num_threads; t++)
+        threads.push_back(std::thread(worker, t));
+    worker(0);
+    for (size_t t = 0; t < threads.size(); t++)
+        threads[t].join();
+
+    for (size_t i = 0; i < count; i++)
+        if (errors[i])
+            std::rethrow_exception(errors[i]);
+}
@@ -0,0 +1,23 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <cstddef>
+#include <functional>
+
+// Number of threads used when 0 threads are requested
+int default_num_threads();
+
+// Calls fn(i) for every i in [0, count) on up to num_threads threads
+// (0 - one per hardware thread), the calling thread takes part in the work.
+// Indices are handed out in increasing order. If some calls throw, the
+// remaining indices still run and the exception of the smallest index is
+// rethrown once all threads are done, so errors are reported deterministically.
+void parallel_for(size_t count, int num_threads, const std::function<void(size_t)>& fn);
+
+// Same contract as parallel_for, but suited to a few coarse tasks of uneven
+// cost: every thread starts with its own contiguous share of the indices,
+// takes them from the front and, once it runs dry, steals from the back of
+// the share with the most indices left.
+void parallel_for_stealing(size_t count, int num_threads, const std::function<void(size_t)>& fn);
+
+#endif // PARALLEL_H
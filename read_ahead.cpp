@@ -0,0 +1,168 @@
+#include "read_ahead.h"
+#include <stdexcept>
+#include <algorithm>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+ReadAheadFile::ReadAheadFile(size_t block_size, int depth, int num_threads) :
+    fd(-1), file_size(0), num_threads(std::max(1, num_threads)),
+    range_begin(0), range_end(0), first_block(0), end_block(0), next_block(0), consumed_block(0), holding(false),
+    stopping(false), slots(std::max(1, depth))
+{
+    this->block_size = (std::max<size_t>(block_size, 1) + READ_AHEAD_ALIGNMENT - 1) / READ_AHEAD_ALIGNMENT * READ_AHEAD_ALIGNMENT;
+    for (size_t i = 0; i < slots.size(); i++)
+    {
+        void * buffer = 0;
+        if (::posix_memalign(&buffer, READ_AHEAD_ALIGNMENT, this->block_size) != 0)
+            throw std::bad_alloc();
+        slots[i].buffer = static_cast<char*>(buffer);
+        slots[i].state = Slot::EMPTY;
+    }
+}
+
+ReadAheadFile::~ReadAheadFile()
+{
+    Close();
+    for (size_t i = 0; i < slots.size(); i++)
+        ::free(slots[i].buffer);
+}
+
+bool ReadAheadFile::Open(const std::string& path)
+{
+    Close();
+    fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+    struct stat st;
+    file_size = (::fstat(fd, &st) == 0) ? st.st_size : 0;
+    ::posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    this->path = path;
+    return true;
+}
+
+void ReadAheadFile::Close()
+{
+    stop();
+    if (fd >= 0)
+        ::close(fd);
+    fd = -1;
+    file_size = 0;
+}
+
+void ReadAheadFile::stop()
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+    }
+    changed.notify_all();
+    for (size_t t = 0; t < threads.size(); t++)
+        threads[t].join();
+    threads.clear();
+    stopping = false;
+    for (size_t i = 0; i < slots.size(); i++)
+        slots[i].state = Slot::EMPTY;
+}
+
+void ReadAheadFile::ReadAt(size_t offset, void * dst, size_t count) const
+{
+    char * out = static_cast<char*>(dst);
+    while (count > 0)
+    {
+        ssize_t done = ::pread(fd, out, count, offset);
+        if (done < 0 && errno == EINTR)
+            continue;
+        if (done <= 0)
+            throw std::runtime_error("Error in reading file " + path + ": " + (done < 0 ? strerror(errno) : "unexpected end of file"));
+        out += done;
+        offset += done;
+        count -= done;
+    }
+}
+
+void ReadAheadFile::Start(size_t begin, size_t end)
+{
+    stop();
+    range_begin = begin;
+    range_end = std::max(begin, std::min(end, file_size));
+    first_block = range_begin / block_size;
+    end_block = (range_end + block_size - 1) / block_size;
+    if (range_begin == range_end)
+        end_block = first_block;
+    next_block = first_block;
+    consumed_block = first_block;
+    holding = false;
+    int count = std::min<size_t>(num_threads, std::min(slots.size(), end_block - first_block));
+    for (int t = 0; t < count; t++)
+        threads.push_back(std::thread(&ReadAheadFile::worker, this));
+}
+
+void ReadAheadFile::worker()
+{
+    std::unique_lock<std::mutex> guard(lock);
+    while (true)
+    {
+        // A block may be read once its slot has been given back by the consumer
+        changed.wait(guard, [&]()
+        {
+            return stopping || next_block >= end_block || slots[next_block % slots.size()].state == Slot::EMPTY;
+        });
+        if (stopping || next_block >= end_block)
+            return;
+        size_t block = next_block++;
+        Slot& slot = slots[block % slots.size()];
+        slot.state = Slot::READING;
+        slot.block = block;
+        guard.unlock();
+
+        size_t offset = std::max(block * block_size, range_begin);
+        size_t size = std::min((block + 1) * block_size, range_end) - offset;
+        size_t done = 0;
+        int error = 0;
+        while (done < size)
+        {
+            ssize_t count = ::pread(fd, slot.buffer + done, size - done, offset + done);
+            if (count < 0 && errno == EINTR)
+                continue;
+            if (count <= 0)
+            {
+                error = (count < 0) ? errno : EIO;
+                break;
+            }
+            done += count;
+        }
+
+        guard.lock();
+        slot.size = done;
+        slot.error = error;
+        slot.state = Slot::READY;
+        changed.notify_all();
+    }
+}
+
+bool ReadAheadFile::Next(const char *& data, size_t& size)
+{
+    std::unique_lock<std::mutex> guard(lock);
+    if (holding)
+    {
+        // Giving the previous block's slot back to the readers
+        slots[(consumed_block - 1) % slots.size()].state = Slot::EMPTY;
+        holding = false;
+        changed.notify_all();
+    }
+    if (consumed_block >= end_block)
+        return false;
+    size_t block = consumed_block++;
+    Slot& slot = slots[block % slots.size()];
+    changed.wait(guard, [&]() { return slot.state == Slot::READY && slot.block == block; });
+    holding = true;
+    if (slot.error)
+        throw std::runtime_error("Error in reading file " + path + ": " + strerror(slot.error));
+    data = slot.buffer;
+    size = slot.size;
+    return true;
+}
@@ -0,0 +1,75 @@
+#ifndef READ_AHEAD_H
+#define READ_AHEAD_H
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cstddef>
+
+// Alignment of read-ahead buffers and file offsets of blocks
+#define READ_AHEAD_ALIGNMENT 4096
+
+// Sequential reader that keeps several large reads in flight.
+// A range of the file is read in blocks of block_size bytes (aligned to
+// block_size in the file) by background threads with pread, up to depth
+// blocks ahead of the consumer, so that reading overlaps with decoding.
+class ReadAheadFile
+{
+public:
+
+    // block_size is rounded up to READ_AHEAD_ALIGNMENT
+    ReadAheadFile(size_t block_size, int depth, int num_threads);
+    ~ReadAheadFile();
+
+    bool Open(const std::string& path);
+    void Close();
+    size_t Size() const { return file_size; }
+
+    // Reads count bytes at offset synchronously, throws std::runtime_error on failure
+    void ReadAt(size_t offset, void * dst, size_t count) const;
+
+    // Starts reading [begin, end) in the background
+    void Start(size_t begin, size_t end);
+    // Waits for the next piece of the range, it stays valid until the next call.
+    // Returns false once the range is over, throws std::runtime_error if a read failed.
+    bool Next(const char *& data, size_t& size);
+
+private:
+
+    ReadAheadFile(const ReadAheadFile&);
+    ReadAheadFile& operator=(const ReadAheadFile&);
+
+    struct Slot
+    {
+        char * buffer;
+        size_t block;
+        size_t size;
+        int error;
+        enum { EMPTY, READING, READY } state;
+    };
+
+    void stop();
+    void worker();
+
+    std::string path;
+    int fd;
+    size_t file_size;
+    size_t block_size;
+    int num_threads;
+
+    // Blocks of the range: [first_block, end_block), the first one starts at begin
+    size_t range_begin, range_end;
+    size_t first_block, end_block;
+    size_t next_block;     // next block to read
+    size_t consumed_block; // next block to hand to the consumer
+    bool holding;          // whether the consumer holds the block before consumed_block
+    bool stopping;
+    std::vector<Slot> slots;
+    std::mutex lock;
+    std::condition_variable changed;
+    std::vector<std::thread> threads;
+};
+
+#endif // READ_AHEAD_H
@@ -0,0 +1,295 @@
+#include "resample.h"
+#include <math.h>
+#include <algorithm>
+#include <stdexcept>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define RESAMPLE_X86
+#include <immintrin.h>
+#endif
+
+template <typename Scalar>
+void LinearResampler<Scalar>::Plan(const std::vector<Scalar>& times, Scalar time_interval)
+{
+    std::vector<Scalar>& sample_times = this->sample_times;
+    sample_times.clear();
+    left.clear();
+    weight_right.clear();
+    weight_left.clear();
+    span.clear();
+    if (times.size() < 2)
+        return;
+
+    Scalar cur_time = times[0];
+    size_t cur_index = 1;
+    while (cur_time < times.back())
+    {
+        while (cur_index < times.size() && cur_time > times[cur_index])
+            cur_index++;
+        sample_times.push_back(cur_time);
+        left.push_back(cur_index - 1);
+        weight_right.push_back(cur_time - times[cur_index-1]);
+        weight_left.push_back(times[cur_index] - cur_time);
+        span.push_back(times[cur_index] - times[cur_index-1]);
+        cur_time += time_interval;
+    }
+}
+
+template <typename Scalar>
+static void apply_linear_scalar(const Scalar * input, const int32_t * left, const Scalar * weight_right,
+                                const Scalar * weight_left, const Scalar * span, Scalar * output, size_t count)
+{
+    for (size_t k = 0; k < count; k++)
+    {
+        // Linear approx:
+        output[k] = (weight_right[k] * input[left[k] + 1] + weight_left[k] * input[left[k]]) / span[k];
+    }
+}
+
+#ifdef RESAMPLE_X86
+
+// Same arithmetic as the scalar loop (no fused multiply-add), so results are bitwise equal
+__attribute__((target("avx2")))
+static void apply_linear_avx2(const float * input, const int32_t * left, const float * weight_right,
+                              const float * weight_left, const float * span, float * output, size_t count)
+{
+    size_t k = 0;
+    for (; k + 8 <= count; k += 8)
+    {
+        __m256i index = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(left + k));
+        __m256 value_left = _mm256_i32gather_ps(input, index, 4);
+        __m256 value_right = _mm256_i32gather_ps(input + 1, index, 4);
+        __m256 sum = _mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(weight_right + k), value_right),
+                                   _mm256_mul_ps(_mm256_loadu_ps(weight_left + k), value_left));
+        _mm256_storeu_ps(output + k, _mm256_div_ps(sum, _mm256_loadu_ps(span + k)));
+    }
+    apply_linear_scalar(input, left + k, weight_right + k, weight_left + k, span + k, output + k, count - k);
+}
+
+static bool resample_has_avx2()
+{
+    static const bool supported = (__builtin_cpu_init(), __builtin_cpu_supports("avx2"));
+    return supported;
+}
+
+#endif // RESAMPLE_X86
+
+template <typename Scalar>
+static void apply_linear(const Scalar * input, const int32_t * left, const Scalar * weight_right,
+                         const Scalar * weight_left, const Scalar * span, Scalar * output, size_t count)
+{
+    apply_linear_scalar(input, left, weight_right, weight_left, span, output, count);
+}
+
+static void apply_linear(const float * input, const int32_t * left, const float * weight_right,
+                         const float * weight_left, const float * span, float * output, size_t count)
+{
+#ifdef RESAMPLE_X86
+    if (resample_has_avx2())
+    {
+        apply_linear_avx2(input, left, weight_right, weight_left, span, output, count);
+        return;
+    }
+#endif
+    apply_linear_scalar(input, left, weight_right, weight_left, span, output, count);
+}
+
+template <typename Scalar>
+void LinearResampler<Scalar>::Apply(const Scalar * input, size_t input_offset, Scalar * output, size_t begin, size_t end) const
+{
+    if (end <= begin)
+        return;
+    // Indices are relative to input_offset, which can't exceed the first one used
+    static thread_local std::vector<int32_t> shifted;
+    const int32_t * indices = &left[begin];
+    if (input_offset > 0)
+    {
+        shifted.resize(end - begin);
+        for (size_t k = begin; k < end; k++)
+            shifted[k - begin] = left[k] - int32_t(input_offset);
+        indices = shifted.data();
+    }
+    apply_linear(input, indices, &weight_right[begin], &weight_left[begin], &span[begin], output, end - begin);
+}
+
+// |||||||||||||||||||||||||||||||||||||||||||||||||||||||||||||||||||||||| //
+// |||||||||||||||||||||||| SincResampler ||||||||||||||||||||||||||||||||| //
+// |||||||||||||||||||||||||||||||||||||||||||||||||||||||||||||||||||||||| //
+
+// Modified Bessel function of the first kind of order 0
+static double bessel_i0(double x)
+{
+    double sum = 1.0;
+    double term = 1.0;
+    for (int k = 1; k < 64; k++)
+    {
+        term *= (x / (2.0 * k)) * (x / (2.0 * k));
+        sum += term;
+        if (term < sum * 1e-17)
+            break;
+    }
+    return sum;
+}
+
+template <typename Scalar>
+void SincResampler<Scalar>::Plan(const std::vector<Scalar>& times, Scalar time_interval)
+{
+    std::vector<Scalar>& sample_times = this->sample_times;
+    sample_times.clear();
+    first_tap.clear();
+    phase.clear();
+    num_inputs = times.size();
+    if (times.size() < 2)
+        return;
+    // The kernels place inputs at multiples of the mean interval
+    if (!is_uniform_time_grid(times, SINC_UNIFORM_TOLERANCE))
+        throw std::runtime_error("Error: sinc resampling needs equidistant input times, use linear resampling for these files");
+
+    // Same output times as the linear resampler
+    Scalar cur_time = times[0];
+    while (cur_time < times.back())
+    {
+        sample_times.push_back(cur_time);
+        cur_time += time_interval;
+    }
+
+    // Kernel: cutoff at the lower of the input and output Nyquist frequencies,
+    // its length grows with the decimation ratio to keep the transition band
+    double input_interval = double(times.back() - times[0]) / (times.size() - 1);
+    double cutoff = std::min(1.0, input_interval / double(time_interval));
+    size_t half_width = std::min<size_t>(ceil(SINC_HALF_WIDTH / cutoff), 512);
+    num_taps = (2 * half_width + 7) / 8 * 8;
+    kernels.assign((SINC_PHASES + 1) * num_taps, Scalar(0));
+    for (size_t p = 0; p <= SINC_PHASES; p++)
+    {
+        // Tap m multiplies input first_tap + m, first_tap = floor(position) - half_width + 1
+        double fraction = double(p) / SINC_PHASES;
+        double sum = 0.0;
+        std::vector<double> kernel(num_taps);
+        for (size_t m = 0; m < num_taps; m++)
+        {
+            double u = double(m) - double(half_width) + 1.0 - fraction;
+            double r = u / half_width;
+            if (fabs(r) >= 1.0)
+                continue;
+            double x = M_PI * cutoff * u;
+            double sinc = (fabs(x) < 1e-12) ? 1.0 : sin(x) / x;
+            kernel[m] = sinc * bessel_i0(SINC_KAISER_BETA * sqrt(1.0 - r * r)) / bessel_i0(SINC_KAISER_BETA);
+            sum += kernel[m];
+        }
+        // Unit gain at zero frequency
+        for (size_t m = 0; m < num_taps; m++)
+            kernels[p * num_taps + m] = Scalar(kernel[m] / sum);
+    }
+
+    first_tap.resize(sample_times.size());
+    phase.resize(sample_times.size());
+    for (size_t k = 0; k < sample_times.size(); k++)
+    {
+        double position = double(sample_times[k] - times[0]) / input_interval;
+        double base = floor(position);
+        size_t p = size_t(floor((position - base) * SINC_PHASES + 0.5));
+        first_tap[k] = int32_t(base) - int32_t(half_width) + 1;
+        phase[k] = p;
+    }
+}
+
+template <typename Scalar>
+static Scalar dot_scalar(const Scalar * kernel, const Scalar * input, size_t count)
+{
+    Scalar sum = 0;
+    for (size_t m = 0; m < count; m++)
+        sum += kernel[m] * input[m];
+    return sum;
+}
+
+#ifdef RESAMPLE_X86
+
+// count is a multiple of 8
+__attribute__((target("avx2")))
+static float dot_avx2(const float * kernel, const float * input, size_t count)
+{
+    __m256 sum0 = _mm256_setzero_ps();
+    __m256 sum1 = _mm256_setzero_ps();
+    size_t m = 0;
+    for (; m + 16 <= count; m += 16)
+    {
+        sum0 = _mm256_add_ps(sum0, _mm256_mul_ps(_mm256_loadu_ps(kernel + m), _mm256_loadu_ps(input + m)));
+        sum1 = _mm256_add_ps(sum1, _mm256_mul_ps(_mm256_loadu_ps(kernel + m + 8), _mm256_loadu_ps(input + m + 8)));
+    }
+    for (; m < count; m += 8)
+        sum0 = _mm256_add_ps(sum0, _mm256_mul_ps(_mm256_loadu_ps(kernel + m), _mm256_loadu_ps(input + m)));
+    __m256 sum = _mm256_add_ps(sum0, sum1);
+    __m128 half = _mm_add_ps(_mm256_castps256_ps128(sum), _mm256_extractf128_ps(sum, 1));
+    half = _mm_add_ps(half, _mm_movehl_ps(half, half));
+    half = _mm_add_ss(half, _mm_shuffle_ps(half, half, 1));
+    return _mm_cvtss_f32(half);
+}
+
+#endif // RESAMPLE_X86
+
+template <typename Scalar>
+static Scalar dot(const Scalar * kernel, const Scalar * input, size_t count)
+{
+    return dot_scalar(kernel, input, count);
+}
+
+static float dot(const float * kernel, const float * input, size_t count)
+{
+#ifdef RESAMPLE_X86
+    if (resample_has_avx2())
+        return dot_avx2(kernel, input, count);
+#endif
+    return dot_scalar(kernel, input, count);
+}
+
+template <typename Scalar>
+void SincResampler<Scalar>::Apply(const Scalar * input, size_t input_offset, Scalar * output, size_t begin, size_t end) const
+{
+    for (size_t k = begin; k < end; k++)
+    {
+        const Scalar * kernel = &kernels[phase[k] * num_taps];
+        int64_t first = first_tap[k];
+        if (first >= 0 && first + int64_t(num_taps) <= int64_t(num_inputs))
+        {
+            output[k - begin] = dot(kernel, input + (first - int64_t(input_offset)), num_taps);
+        }
+        else
+        {
+            // Near the edges the outermost samples are repeated
+            Scalar sum = 0;
+            for (size_t m = 0; m < num_taps; m++)
+                sum += kernel[m] * input[clamp_input(first + int64_t(m)) - input_offset];
+            output[k - begin] = sum;
+        }
+    }
+}
+
+template <typename Scalar>
+bool is_uniform_time_grid(const std::vector<Scalar>& times, double tolerance)
+{
+    if (times.size() < 2)
+        return true;
+    const double interval = double(times.back() - times[0]) / (times.size() - 1);
+    if (interval <= 0.0)
+        return false;
+    for (size_t i = 1; i + 1 < times.size(); i++)
+    {
+        if (fabs(double(times[i]) - double(times[0]) - interval * i) > tolerance * interval)
+            return false;
+    }
+    return true;
+}
+
+template <typename Scalar>
+Resampler<Scalar>* create_resampler(ResamplingType type)
+{
+    if (type == SINC_RESAMPLING)
+        return new SincResampler<Scalar>();
+    return new LinearResampler<Scalar>();
+}
+
+template class LinearResampler<float>;
+template class SincResampler<float>;
+template Resampler<float>* create_resampler<float>(ResamplingType type);
+template bool is_uniform_time_grid<float>(const std::vector<float>& times, double tolerance);
@@ -0,0 +1,122 @@
+#ifndef RESAMPLE_H
+#define RESAMPLE_H
+
+#include <vector>
+#include <cstddef>
+#include <stdint.h>
+
+enum ResamplingType
+{
+    // Linear interpolation between the two bracketing samples
+    LINEAR_RESAMPLING,
+    // Band-limited polyphase windowed-sinc interpolation, low-pass filters when decimating
+    SINC_RESAMPLING
+};
+
+// Resampling of traces onto an equidistant time grid.
+// All traces share the input times, so everything that depends only on the
+// grids is computed once by Plan and then applied to any number of traces
+// without allocations.
+template <typename Scalar>
+class Resampler
+{
+public:
+
+    virtual ~Resampler() {}
+
+    // Output grid of interpolate_data_on_equal_time_intervals: starts at times[0]
+    // and steps by time_interval while staying below times.back()
+    virtual void Plan(const std::vector<Scalar>& times, Scalar time_interval) = 0;
+
+    size_t OutputSize() const { return sample_times.size(); }
+    // Time at which every output sample is taken
+    const std::vector<Scalar>& SampleTimes() const { return sample_times; }
+    // Input samples [FirstInput(begin), LastInput(end - 1)] produce outputs [begin, end)
+    virtual size_t FirstInput(size_t output) const = 0;
+    virtual size_t LastInput(size_t output) const = 0;
+
+    // output[k - begin] for k in [begin, end), input[i - input_offset] is the i-th input sample
+    virtual void Apply(const Scalar * input, size_t input_offset, Scalar * output, size_t begin, size_t end) const = 0;
+    void Apply(const Scalar * input, Scalar * output) const
+    {
+        Apply(input, 0, output, 0, OutputSize());
+    }
+
+protected:
+
+    std::vector<Scalar> sample_times;
+};
+
+template <typename Scalar>
+class LinearResampler : public Resampler<Scalar>
+{
+public:
+
+    using Resampler<Scalar>::Apply;
+
+    void Plan(const std::vector<Scalar>& times, Scalar time_interval);
+    size_t FirstInput(size_t output) const { return left[output]; }
+    size_t LastInput(size_t output) const { return left[output] + 1; }
+    void Apply(const Scalar * input, size_t input_offset, Scalar * output, size_t begin, size_t end) const;
+
+private:
+
+    // output = (weight_right * input[left + 1] + weight_left * input[left]) / span
+    std::vector<int32_t> left;
+    std::vector<Scalar> weight_right;
+    std::vector<Scalar> weight_left;
+    std::vector<Scalar> span;
+};
+
+// Input samples must be equidistant up to SINC_UNIFORM_TOLERANCE of the interval, which covers
+// the rounding of times printed into CSV files; Plan throws std::runtime_error otherwise.
+// Every output sample is a dot product of SincResampler::num_taps inputs with
+// one of SINC_PHASES precomputed Kaiser-windowed sinc kernels, picked by the
+// fractional position of the output between two inputs. When decimating the
+// kernel cutoff drops to the output Nyquist frequency, so nothing aliases.
+// Samples before the first and after the last input repeat the edge values.
+#define SINC_PHASES 512
+#define SINC_HALF_WIDTH 16
+#define SINC_KAISER_BETA 8.6
+#define SINC_UNIFORM_TOLERANCE 0.1
+
+template <typename Scalar>
+class SincResampler : public Resampler<Scalar>
+{
+public:
+
+    using Resampler<Scalar>::Apply;
+
+    SincResampler() : num_taps(0), num_inputs(0) {}
+
+    void Plan(const std::vector<Scalar>& times, Scalar time_interval);
+    size_t FirstInput(size_t output) const { return clamp_input(first_tap[output]); }
+    size_t LastInput(size_t output) const { return clamp_input(int64_t(first_tap[output]) + num_taps - 1); }
+    void Apply(const Scalar * input, size_t input_offset, Scalar * output, size_t begin, size_t end) const;
+
+private:
+
+    size_t clamp_input(int64_t i) const { return i < 0 ? 0 : (i >= int64_t(num_inputs) ? num_inputs - 1 : i); }
+
+    // Kernels of all phases, num_taps each
+    std::vector<Scalar> kernels;
+    size_t num_taps;
+    size_t num_inputs;
+    // Input index of the first tap and kernel phase of every output
+    std::vector<int32_t> first_tap;
+    std::vector<uint16_t> phase;
+};
+
+// Largest deviation of a time from the equidistant grid through the first and the
+// last times, relative to its interval, for which traces are kept on their grid
+#define RESAMPLE_UNIFORM_TOLERANCE 1e-2
+
+// Whether times are increasing and equidistant up to tolerance (relative to the interval)
+template <typename Scalar>
+bool is_uniform_time_grid(const std::vector<Scalar>& times, double tolerance = RESAMPLE_UNIFORM_TOLERANCE);
+
+// Creates a resampler of the given type, the caller owns it
+template <typename Scalar>
+Resampler<Scalar>* create_resampler(ResamplingType type);
+
+#endif // RESAMPLE_H
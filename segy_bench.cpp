@@ -0,0 +1,499 @@
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <iterator>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <stdio.h>
+#include <stdlib.h>
+#include <getopt.h>
+#include <string.h>
+#include <stdexcept>
+#include <sys/stat.h>
+#include "seismogram.h"
+#include "segy_file.h"
+#include "conversion.h"
+#include "segy_index.h"
+#include "ibm_float.h"
+#include "byte_swap.h"
+
+// Benchmarks of the loading, saving, resampling and conversion stages on synthetic
+// gathers, and correctness checks on the bundled fixtures run by ctest
+
+using namespace std;
+
+// Peak frequency of the Ricker wavelets of synthetic gathers, Hz
+#define BENCH_RICKER_FREQUENCY 25.0
+// Sample interval of synthetic gathers, seconds
+#define BENCH_SAMPLE_INTERVAL 0.001
+
+struct BenchGather
+{
+    IndexType receivers;
+    IndexType samples;
+    int dims;
+    int format;
+};
+
+uint64 bench_file_size(const std::string& path)
+{
+    struct stat st;
+    return (::stat(path.c_str(), &st) == 0) ? st.st_size : 0;
+}
+
+double seconds_since(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Runs stage repeat times, each after an untimed prepare, and prints the best time with
+// the throughput of bytes and samples, returns the best throughput in MB/s
+template <typename Prepare, typename Stage>
+double run_stage(const char * name, int repeat, uint64 bytes, uint64 samples, Prepare prepare, Stage stage)
+{
+    double best = 0.0;
+    for (int r = 0; r < repeat; r++)
+    {
+        prepare();
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        stage();
+        double time = seconds_since(start);
+        if (r == 0 || time < best)
+            best = time;
+    }
+    best = std::max(best, 1e-9);
+    const double mb_per_s = bytes / best / (1024.0 * 1024.0);
+    cout << "  " << left << setw(18) << name << right << fixed
+         << setw(10) << setprecision(3) << best * 1000.0 << " ms"
+         << setw(10) << setprecision(1) << mb_per_s << " MB/s"
+         << setw(10) << setprecision(2) << samples / best / 1e6 << " Msamples/s" << endl;
+    cout.unsetf(std::ios::floatfield);
+    return mb_per_s;
+}
+
+template <typename Stage>
+double run_stage(const char * name, int repeat, uint64 bytes, uint64 samples, Stage stage)
+{
+    return run_stage(name, repeat, bytes, samples, []() {}, stage);
+}
+
+// Fills s with a gather of Ricker wavelets arriving along a hyperbola plus a little noise,
+// receivers along a line 10 m apart with the source at its start
+template <int dims>
+void make_gather(CombinedSeismogramm<float, dims>& s, const BenchGather& gather)
+{
+    typedef typename CombinedSeismogramm<float, dims>::Elastic SeismoElastic;
+    s.componentInfos.clear();
+    s.AddComponent("", new VxGetter<SeismoElastic, dims>());
+    s.AddComponent("", new VyGetter<SeismoElastic, dims>());
+    if (dims >= 3)
+        s.AddComponent("", new VzGetter<SeismoElastic, dims>());
+    s.sample_format = gather.format;
+
+    s.times.resize(gather.samples);
+    for (IndexType t = 0; t < gather.samples; t++)
+        s.times[t] = t * BENCH_SAMPLE_INTERVAL;
+
+    const segy_bin_header_data bin_header =
+        make_segy_bin_header(gather.receivers, gather.samples, BENCH_SAMPLE_INTERVAL * 1e6, gather.format);
+    const double a = M_PI * BENCH_RICKER_FREQUENCY;
+    uint32 random = 12345;
+    s.seismogramms.resize(dims);
+    for (int k = 0; k < dims; k++)
+    {
+        Seismogramm<float>& component = s.seismogramms[k];
+        component.header_data = bin_header;
+        component.data.resize(gather.receivers, gather.samples);
+        component.trace_header_data.resize(gather.receivers);
+        for (IndexType i = 0; i < gather.receivers; i++)
+        {
+            const float rec_x = 10.0f * i;
+            component.trace_header_data[i] = make_segy_trace_header<float>(i, rec_x, 0.0f, 0.0f, 0.0f, bin_header);
+            const double arrival = 0.1 + sqrt(0.01 + (rec_x / 2000.0) * (rec_x / 2000.0));
+            float * trace = &component.data[i][0];
+            for (IndexType t = 0; t < gather.samples; t++)
+            {
+                const double x = a * (s.times[t] - arrival);
+                random = random * 1664525u + 1013904223u;
+                trace[t] = float((1.0 - 2.0 * x * x) * exp(-x * x) / (1.0 + k)) + (random >> 8) * 1e-10f;
+            }
+        }
+    }
+}
+
+void remove_files(const std::vector<std::string>& paths)
+{
+    for (size_t i = 0; i < paths.size(); i++)
+        ::remove(paths[i].c_str());
+}
+
+template <int dims>
+void bench_gather(const BenchGather& gather, const std::string& dir, int repeat)
+{
+    typedef CombinedSeismogramm<float, dims> Seismo;
+    cout << gather.receivers << " receivers x " << gather.samples << " samples, " << dims << "D, "
+         << ((gather.format == SEGY_FORMAT_IBM_FLOAT) ? "IBM" : "IEEE") << endl;
+
+    const std::string base = dir + "/segy_bench";
+    const char * suffixes[3] = { "_x.segy", "_y.segy", "_z.segy" };
+    std::vector<std::string> segy_files;
+    for (int k = 0; k < dims; k++)
+        segy_files.push_back(base + suffixes[k]);
+    std::vector<std::string> csv_files(1, base);
+    std::vector<std::string> all_files = segy_files;
+    all_files.push_back(base + ".csv");
+    all_files.push_back(base + ".rec.txt");
+    all_files.push_back(base + ".expl.txt");
+
+    Seismo source;
+    make_gather(source, gather);
+    const uint64 samples = uint64(gather.receivers) * gather.samples * dims;
+
+    run_stage("SaveSegY", repeat, uint64(segy_trace_size(source.seismogramms[0].header_data)) * gather.receivers * dims,
+              samples, [&]()
+    {
+        for (int k = 0; k < dims; k++)
+            source.seismogramms[k].SaveSegY(segy_files[k], source.times);
+    });
+    uint64 segy_bytes = 0;
+    for (int k = 0; k < dims; k++)
+        segy_bytes += bench_file_size(segy_files[k]);
+
+    std::vector<float> times;
+    Seismogramm<float> loaded;
+    run_stage("LoadSegY mmap", repeat, segy_bytes, samples, [&]()
+    {
+        for (int k = 0; k < dims; k++)
+            loaded.LoadSegY(segy_files[k], times);
+    });
+    run_stage("LoadSegY pread", repeat, segy_bytes, samples, [&]()
+    {
+        for (int k = 0; k < dims; k++)
+            loaded.LoadSegY(segy_files[k], times, SegYReadOptions(4));
+    });
+
+    // Both resample the gather in place, every run gets a fresh copy
+    Seismo copy;
+    run_stage("interpolate", repeat, samples * sizeof(float), samples, [&]() { copy = source; }, [&]()
+    {
+        copy.interpolate_data_on_equal_time_intervals(BENCH_SAMPLE_INTERVAL * 0.5);
+    });
+    run_stage("Save(CSV)", repeat, samples * sizeof(float), samples, [&]() { copy = source; }, [&]()
+    {
+        copy.Save(CSV, csv_files);
+    });
+    const uint64 csv_bytes = bench_file_size(base + ".csv");
+    run_stage("Load(CSV)", repeat, csv_bytes, samples, [&]()
+    {
+        copy.Load(CSV, csv_files);
+    });
+
+    ConversionOptions options;
+    options.dims = dims;
+    options.segy_format = gather.format;
+    const ConversionShot shot(base, base);
+    options.type = TO_SEGY;
+    run_stage("tosegy", repeat, csv_bytes, samples, [&]() { convert_shot(shot, options); });
+    options.type = TO_CSV;
+    run_stage("tocsv", repeat, segy_bytes, samples, [&]() { convert_shot(shot, options); });
+    cout << endl;
+
+    remove_files(all_files);
+}
+
+// Whether two loaded SEG-Y files have the same times, samples and trace headers
+bool same_seismogramm(const Seismogramm<float>& a, const std::vector<float>& a_times,
+                      const Seismogramm<float>& b, const std::vector<float>& b_times)
+{
+    bool same = a.data.rows() == b.data.rows() && a.data.cols() == b.data.cols() && a_times == b_times &&
+        a.trace_header_data.size() == b.trace_header_data.size() &&
+        memcmp(a.trace_header_data.data(), b.trace_header_data.data(), a.trace_header_data.size() * sizeof(segy_trace_header)) == 0;
+    for (size_t i = 0; same && i < a.data.rows(); i++)
+        same = memcmp(&a.data[i][0], &b.data[i][0], a.data.cols() * sizeof(float)) == 0;
+    return same;
+}
+
+// Whether two files have the same bytes
+bool same_file(const std::string& a, const std::string& b)
+{
+    std::ifstream in_a(a.c_str(), std::ios::binary), in_b(b.c_str(), std::ios::binary);
+    std::string text_a((std::istreambuf_iterator<char>(in_a)), std::istreambuf_iterator<char>());
+    std::string text_b((std::istreambuf_iterator<char>(in_b)), std::istreambuf_iterator<char>());
+    return in_a && in_b && text_a == text_b;
+}
+
+// Prints the result of a check and counts it in failed
+void report_check(const std::string& name, bool ok, int& failed)
+{
+    cout << name << ": " << (ok ? "ok" : "FAILED") << endl;
+    if (!ok)
+        failed++;
+}
+
+// Checks that index queries of a copy of a loaded SEG-Y file at path, with receivers and
+// offsets spread over its traces, read the same traces as picking them from the whole
+// file; the sidecar index is built and then reused
+void check_index_queries(const std::string& path, const Seismogramm<float>& loaded,
+                         const std::vector<float>& times, int& failed)
+{
+    Seismogramm<float> original = loaded;
+    for (size_t i = 0; i < original.trace_header_data.size(); i++)
+    {
+        original.trace_header_data[i].receiver_x = 10 * i;
+        original.trace_header_data[i].receiver_y = 5 * (i % 7);
+        original.trace_header_data[i].distance_from_source = 25 * (i * 37 % original.trace_header_data.size());
+    }
+    original.SaveSegY(path, times);
+    ::remove(segy_index_path(path).c_str());
+    SegYIndex index, reused;
+    index.Open(path);
+    report_check("Index of " + path + " reused", reused.Load(segy_index_path(path), path) &&
+                 reused.NumTraces() == index.NumTraces(), failed);
+
+    // The middle half of the receivers and of the offsets
+    const std::vector<segy_trace_header>& headers = original.trace_header_data;
+    std::vector<uint32> xs, offsets;
+    for (size_t i = 0; i < headers.size(); i++)
+    {
+        xs.push_back(headers[i].receiver_x);
+        offsets.push_back(headers[i].distance_from_source);
+    }
+    std::sort(xs.begin(), xs.end());
+    std::sort(offsets.begin(), offsets.end());
+    SegYTraceQuery queries[2];
+    queries[0].by_receiver = true;
+    queries[0].receiver_x_min = xs[xs.size() / 4];
+    queries[0].receiver_x_max = xs[xs.size() * 3 / 4];
+    queries[1].by_offset = true;
+    queries[1].min_offset = offsets[offsets.size() / 4];
+    queries[1].max_offset = offsets[offsets.size() * 3 / 4];
+    for (int q = 0; q < 2; q++)
+    {
+        Seismogramm<float> expected, found;
+        std::vector<float> found_times;
+        for (size_t i = 0; i < headers.size(); i++)
+        {
+            const segy_trace_header& header = headers[i];
+            if (queries[q].by_receiver && (header.receiver_x < queries[q].receiver_x_min || header.receiver_x > queries[q].receiver_x_max))
+                continue;
+            if (queries[q].by_offset && (header.distance_from_source < queries[q].min_offset ||
+                                         header.distance_from_source > queries[q].max_offset))
+                continue;
+            expected.trace_header_data.push_back(header);
+            expected.data.resize(expected.data.rows() + 1, original.data.cols());
+            memcpy(&expected.data[expected.data.rows() - 1][0], &original.data[i][0], original.data.cols() * sizeof(float));
+        }
+        found.LoadSegYTraces(path, reused, reused.Find(queries[q]), found_times);
+        report_check(std::string(q == 0 ? "Receiver" : "Offset") + " query of " + path + " (" +
+                     std::to_string(expected.data.rows()) + " traces)",
+                     expected.data.rows() > 0 && same_seismogramm(expected, times, found, found_times), failed);
+    }
+    ::remove(segy_index_path(path).c_str());
+}
+
+// Checks the IBM kernels and the round trip of the fixtures <fixture>_x.segy and
+// <fixture>_y.segy. The throughput of converting them to CSV is reported, and checked
+// only if min_mb_per_s > 0. Returns the number of failed checks.
+int check_fixtures(const std::string& fixture, const std::string& dir, int repeat, double min_mb_per_s)
+{
+    int failed = 0;
+    const size_t mismatches = check_ibm_kernels();
+    cout << "IBM kernels: " << mismatches << " mismatches" << endl;
+    if (mismatches != 0)
+        failed++;
+
+    const char * suffixes[2] = { "_x.segy", "_y.segy" };
+    const std::string copy = dir + "/segy_bench_check.segy";
+    uint64 segy_bytes = 0;
+    uint64 samples = 0;
+    for (int k = 0; k < 2; k++)
+    {
+        const std::string path = fixture + suffixes[k];
+        std::vector<float> times, copy_times;
+        Seismogramm<float> original, saved;
+        original.LoadSegY(path, times);
+        original.SaveSegY(copy, times);
+        saved.LoadSegY(copy, copy_times);
+        report_check("Round trip of " + path, same_seismogramm(original, times, saved, copy_times), failed);
+        // Small blocks make traces cross their ends
+        saved.LoadSegY(path, copy_times, SegYReadOptions(3, 5000, 2));
+        report_check("Read-ahead load of " + path, same_seismogramm(original, times, saved, copy_times), failed);
+        check_index_queries(copy, original, times, failed);
+        segy_bytes += bench_file_size(path);
+        samples += uint64(original.data.rows()) * original.data.cols();
+    }
+    ::remove(copy.c_str());
+
+    ConversionOptions options;
+    options.type = TO_CSV;
+    const std::string base = dir + "/segy_bench_check";
+    const ConversionShot shot(fixture, base);
+    const double mb_per_s = run_stage("tocsv", repeat, segy_bytes, samples, [&]() { convert_shot(shot, options); });
+    options.type = TO_SEGY;
+    const ConversionShot back(base, base);
+    run_stage("tosegy", repeat, bench_file_size(base + ".csv"), samples, [&]() { convert_shot(back, options); });
+
+    // tocsv with read-ahead, in one block of rows and in many
+    options.type = TO_CSV;
+    options.segy_read_options = SegYReadOptions(3, 5000, 2);
+    const std::string ahead_base = dir + "/segy_bench_check_ahead";
+    convert_shot(ConversionShot(fixture, ahead_base), options);
+    report_check("Read-ahead tocsv", same_file(base + ".csv", ahead_base + ".csv") &&
+                 same_file(base + ".rec.txt", ahead_base + ".rec.txt"), failed);
+    options.max_memory = 64 * 1024;
+    convert_shot(ConversionShot(fixture, ahead_base), options);
+    report_check("Read-ahead tocsv in blocks", same_file(base + ".csv", ahead_base + ".csv"), failed);
+    options = ConversionOptions();
+
+    // tonpy and fromnpy keep traces on an equidistant grid as they are
+    const std::string npy_base = dir + "/segy_bench_check_npy";
+    options.type = TO_NPY;
+    convert_shot(ConversionShot(fixture, npy_base), options);
+    options.type = FROM_NPY;
+    convert_shot(ConversionShot(npy_base, npy_base), options);
+    options = ConversionOptions();
+    const char * npy_suffixes[] = { "_x.npy", "_y.npy", ".times.npy", ".rec.npy", ".source.npy", "_x.segy", "_y.segy" };
+    for (int k = 0; k < 2; k++)
+    {
+        Seismogramm<float> original, round_trip;
+        std::vector<float> times, round_trip_times;
+        original.LoadSegY(fixture + suffixes[k], times);
+        round_trip.LoadSegY(npy_base + suffixes[k], round_trip_times);
+        // fromnpy rebuilds the trace headers from the positions, only samples and times are compared
+        round_trip.trace_header_data = original.trace_header_data;
+        report_check("NPY round trip of " + fixture + suffixes[k], same_seismogramm(original, times, round_trip, round_trip_times), failed);
+    }
+
+    std::vector<std::string> files;
+    for (int i = 0; i < 7; i++)
+        files.push_back(npy_base + npy_suffixes[i]);
+    files.push_back(base + ".csv");
+    files.push_back(base + ".rec.txt");
+    files.push_back(base + ".expl.txt");
+    files.push_back(base + "_x.segy");
+    files.push_back(base + "_y.segy");
+    files.push_back(ahead_base + ".csv");
+    files.push_back(ahead_base + ".rec.txt");
+    files.push_back(ahead_base + ".expl.txt");
+    remove_files(files);
+    if (min_mb_per_s > 0 && mb_per_s < min_mb_per_s)
+    {
+        cout << "Throughput of tocsv is below " << min_mb_per_s << " MB/s" << endl;
+        failed++;
+    }
+    return failed;
+}
+
+void print_help()
+{
+    printf("Benchmarks of segy_converter stages on synthetic gathers\n\n");
+    printf("Options:\n");
+    printf("  -r  --receivers   number of receivers (default: gathers of several shapes)\n");
+    printf("  -s  --samples     number of samples per trace\n");
+    printf("  -d  --dims        2 or 3 (default 2)\n");
+    printf("  -f  --format      SEG-Y sample format: 1 (IBM) or 5 (IEEE); 0 - both (default)\n");
+    printf("  -n  --repeat      runs of every stage, the best one is reported (default 3)\n");
+    printf("  -o  --dir         directory of temporary files (default .)\n");
+    printf("  -c  --check       check the fixtures <base>_x.segy, <base>_y.segy instead\n");
+    printf("  -m  --min_mbps    lowest tocsv throughput accepted by --check, 0 - not checked (default 0)\n");
+    printf("  -h  --help        print this help\n");
+}
+
+int main(int argc, char ** argv)
+{
+    IndexType receivers = 0;
+    IndexType samples = 0;
+    int dims = 2;
+    int format = 0;
+    int repeat = 3;
+    double min_mb_per_s = 0.0;
+    std::string dir = ".";
+    std::string fixture;
+
+    const char * short_options = "hr:s:d:f:n:o:c:m:";
+    const struct option long_options[] =
+    {
+        { "help", no_argument, NULL, 'h' },
+        { "receivers", required_argument, NULL, 'r' },
+        { "samples", required_argument, NULL, 's' },
+        { "dims", required_argument, NULL, 'd' },
+        { "format", required_argument, NULL, 'f' },
+        { "repeat", required_argument, NULL, 'n' },
+        { "dir", required_argument, NULL, 'o' },
+        { "check", required_argument, NULL, 'c' },
+        { "min_mbps", required_argument, NULL, 'm' },
+        { NULL, 0, NULL, 0 }
+    };
+
+    int res;
+    int option_index;
+    while ((res = getopt_long(argc, argv, short_options, long_options, &option_index)) != -1)
+    {
+        switch (res)
+        {
+            case 'h': print_help(); return 0;
+            case 'r': receivers = atoi(optarg); break;
+            case 's': samples = atoi(optarg); break;
+            case 'd': dims = atoi(optarg); break;
+            case 'f': format = atoi(optarg); break;
+            case 'n': repeat = std::max(1, atoi(optarg)); break;
+            case 'o': dir = optarg; break;
+            case 'c': fixture = optarg; break;
+            case 'm': min_mb_per_s = atof(optarg); break;
+            default: print_help(); return 1;
+        }
+    }
+    if ((dims != 2 && dims != 3) || (format != 0 && format != SEGY_FORMAT_IBM_FLOAT && format != SEGY_FORMAT_IEEE_FLOAT))
+    {
+        print_help();
+        return 1;
+    }
+
+    cout << "Byte swap kernels: " << swap_bytes_kernel_name() << endl;
+    try
+    {
+        if (!fixture.empty())
+        {
+            const int failed = check_fixtures(fixture, dir, repeat, min_mb_per_s);
+            cout << (failed ? "FAILED" : "OK") << endl;
+            return failed ? 1 : 0;
+        }
+
+        std::vector<BenchGather> gathers;
+        const int formats[2] = { SEGY_FORMAT_IEEE_FLOAT, SEGY_FORMAT_IBM_FLOAT };
+        for (int f = 0; f < 2; f++)
+        {
+            if (format != 0 && format != formats[f])
+                continue;
+            if (receivers > 0 || samples > 0)
+            {
+                BenchGather gather = { receivers > 0 ? receivers : 1000, samples > 0 ? samples : 2000, dims, formats[f] };
+                gathers.push_back(gather);
+            }
+            else
+            {
+                // Many short traces, the usual shape and few long traces
+                const IndexType shapes[3][2] = { { 10000, 200 }, { 1000, 2000 }, { 50, 40000 } };
+                for (int i = 0; i < 3; i++)
+                {
+                    BenchGather gather = { shapes[i][0], shapes[i][1], dims, formats[f] };
+                    gathers.push_back(gather);
+                }
+            }
+        }
+        for (size_t i = 0; i < gathers.size(); i++)
+        {
+            if (dims == 3)
+                bench_gather<3>(gathers[i], dir, repeat);
+            else
+                bench_gather<2>(gathers[i], dir, repeat);
+        }
+    }
+    catch (const std::exception& e)
+    {
+        cout << e.what() << endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,99 @@
+#include "segy_file.h"
+
+
+void swap_segy_bin_header(segy_bin_header_data& header)
+{
+    swap_endian<uint32>(header.job_id);
+    swap_endian<uint32>(header.line_num);
+    swap_endian<uint32>(header.reel_num);
+    swap_endian<uint16>(header.num_of_traces_per_record);
+    swap_endian<uint16>(header.num_of_auxiliary_traces_per_record);
+    swap_endian<uint16>(header.sample_interval_reel);
+    swap_endian<uint16>(header.sample_interval);
+    swap_endian<uint16>(header.samples_per_trace_reel);
+    swap_endian<uint16>(header.samples_per_trace);
+    swap_endian<uint16>(header.data_sample_format);
+    swap_endian<uint32>(header.extended_num_of_traces_per_record);
+    swap_endian<uint32>(header.extended_num_of_auxiliary_traces_per_record);
+    swap_endian<uint32>(header.extended_samples_per_trace);
+    swap_endian<double>(header.extended_sample_interval);
+    swap_endian<uint16>(header.segy_revision);
+    swap_endian<uint16>(header.fixed_length_traces);
+    swap_endian<uint16>(header.num_of_extended_text_headers);
+    swap_endian<uint64>(header.num_of_traces_in_file);
+    swap_endian<uint64>(header.first_trace_offset);
+}
+
+void swap_segy_trace_header(segy_trace_header& header)
+{
+    swap_endian<uint32>(header.trace_seq_num_line);
+    swap_endian<uint32>(header.trace_seq_num_reel);
+    swap_endian<uint32>(header.field_record_num);
+    swap_endian<uint32>(header.trace_num_reel);
+    swap_endian<uint16>(header.trace_id_code);
+    swap_endian<uint32>(header.source_x);
+    swap_endian<uint32>(header.source_y);
+    swap_endian<uint32>(header.receiver_x);
+    swap_endian<uint32>(header.receiver_y);
+    swap_endian<uint16>(header.units_id);
+    swap_endian<uint16>(header.num_of_samples);
+    swap_endian<uint16>(header.sample_interval);
+    swap_endian<uint32>(header.distance_from_source);
+    swap_endian<uint16>(header.num_of_verticaly_summed_traces);
+    swap_endian<uint16>(header.num_of_horizotally_summed_traces);
+    swap_endian<uint16>(header.data_use);
+}
+
+segy_bin_header_data make_segy_bin_header(size_t num_of_traces, size_t num_of_samples, double sample_interval,
+                                          int sample_format)
+{
+    // Counts that don't fit 16 bits go to the SEG-Y rev2 extended fields
+    segy_bin_header_data header;
+    memset(&header, 0, sizeof(header));
+    set_segy_sample_interval(header, sample_interval);
+    header.job_id = 1;
+    header.line_num = 1;
+    header.reel_num = 1;
+    set_segy_num_traces(header, num_of_traces);
+    header.num_of_auxiliary_traces_per_record = 0;
+    header.data_sample_format = sample_format;
+    set_segy_samples_per_trace(header, num_of_samples);
+    return header;
+}
+
+// |||||||||||||||||||||||||||||||||||||||||||||||||||||||||||||||||||||||| //
+// |||||||||||||||||||||||| SegYFileView |||||||||||||||||||||||||||||||||| //
+// |||||||||||||||||||||||||||||||||||||||||||||||||||||||||||||||||||||||| //
+
+bool SegYFileView::Open(const std::string& path)
+{
+    Close();
+    if (!file.Open(path) || file.Size() < SEGY_DATA_OFFSET)
+    {
+        file.Close();
+        return false;
+    }
+    memcpy(&header, file.Data() + SEGY_TEXT_HEADER_SIZE, sizeof(header));
+    swap_segy_bin_header(header);
+    check_segy_data_offset(header, file.Size());
+
+    trace_size = segy_trace_size(header);
+    data_offset = std::min<uint64>(segy_data_offset(header), file.Size());
+    num_traces = segy_num_traces(header, file.Size());
+    return true;
+}
+
+void SegYFileView::Close()
+{
+    file.Close();
+    num_traces = 0;
+    trace_size = 0;
+}
+
+segy_trace_header SegYFileView::TraceHeader(IndexType i) const
+{
+    segy_trace_header trace_header;
+    memcpy(&trace_header, RawTraceHeader(i), sizeof(trace_header));
+    swap_segy_trace_header(trace_header);
+    return trace_header;
+}
@@ -0,0 +1,326 @@
+#ifndef SEGY_FILE_H
+#define SEGY_FILE_H
+
+#include "seismogram.h"
+#include "mapped_file.h"
+#include "byte_swap.h"
+#include "ibm_float.h"
+#include "stats.h"
+#include <algorithm>
+#include <cstddef>
+#include <string.h>
+#include <math.h>
+
+#define SEGY_TEXT_HEADER_SIZE 3200
+#define SEGY_DATA_OFFSET (SEGY_TEXT_HEADER_SIZE + sizeof(segy_bin_header_data))
+static_assert(sizeof(segy_bin_header_data) == 400, "the binary header takes 400 bytes of a SEG-Y file");
+static_assert(offsetof(segy_bin_header_data, num_of_traces_in_file) == 312, "rev2 trace count is at bytes 3513-3520");
+static_assert(offsetof(segy_bin_header_data, first_trace_offset) == 320, "rev2 first trace offset is at bytes 3521-3528");
+static_assert(sizeof(segy_trace_header) == 240, "a trace header takes 240 bytes of a SEG-Y file");
+
+// Size of the buffer traces are staged in before being written
+#define SEGY_STAGING_SIZE (4 * 1024 * 1024)
+
+// Data sample format codes of the binary header
+#define SEGY_FORMAT_IBM_FLOAT 1
+#define SEGY_FORMAT_IEEE_FLOAT 5
+
+// Whether samples of the given format can be read and written, 0 (unset) is treated as IEEE
+inline bool is_supported_sample_format(int format)
+{
+    return format != 2 && format != 3 && format != 4;
+}
+
+// Converts native floats to big-endian samples of the given format
+inline void encode_samples(const float * src, void * dst, size_t count, int format)
+{
+    StatsTimer timer(STATS_SWAP, sizeof(float) * count, count);
+    if (format == SEGY_FORMAT_IBM_FLOAT)
+        encode_ibm_big_endian(src, dst, count);
+    else
+        swap_bytes_32(src, dst, count);
+}
+
+// Converts big-endian samples of the given format to native floats
+inline void decode_samples(const void * src, float * dst, size_t count, int format)
+{
+    StatsTimer timer(STATS_SWAP, sizeof(float) * count, count);
+    if (format == SEGY_FORMAT_IBM_FLOAT)
+        decode_ibm_big_endian(src, dst, count);
+    else
+        swap_bytes_32(src, dst, count);
+}
+
+template <typename T>
+void swap_endian(T& pX)
+{
+    // should static assert that T is a POD
+    char& raw = reinterpret_cast<char&>(pX);
+    std::reverse(&raw, &raw + sizeof(T));
+}
+
+template <typename T>
+T swap_endian_copy(T pX)
+{
+    swap_endian(pX);
+    return pX;
+}
+
+// Reads a big-endian value of type T (2 or 4 bytes) from an unaligned pointer
+template <typename T>
+T load_big_endian(const char * ptr)
+{
+    T value;
+    if (sizeof(T) == 4)
+    {
+        uint32 raw;
+        memcpy(&raw, ptr, 4);
+        raw = __builtin_bswap32(raw);
+        memcpy(&value, &raw, 4);
+    }
+    else if (sizeof(T) == 2)
+    {
+        uint16 raw;
+        memcpy(&raw, ptr, 2);
+        raw = __builtin_bswap16(raw);
+        memcpy(&value, &raw, 2);
+    }
+    else
+    {
+        memcpy(&value, ptr, sizeof(T));
+        swap_endian(value);
+    }
+    return value;
+}
+
+void swap_segy_bin_header(segy_bin_header_data& header);
+void swap_segy_trace_header(segy_trace_header& header);
+
+// Binary header fields: the SEG-Y rev2 extended fields are used when the file
+// is rev2 and they are set, counts that don't fit 16 bits are stored in them
+
+#define SEGY_REVISION_2 0x0200
+// Largest count that fits the 16-bit header fields
+#define SEGY_MAX_SHORT_COUNT 0xFFFF
+
+inline bool is_segy_rev2(const segy_bin_header_data& header)
+{
+    return header.segy_revision >= SEGY_REVISION_2;
+}
+
+inline void make_segy_rev2(segy_bin_header_data& header)
+{
+    if (!is_segy_rev2(header))
+    {
+        header.segy_revision = SEGY_REVISION_2;
+        header.fixed_length_traces = 1;
+    }
+}
+
+inline IndexType segy_samples_per_trace(const segy_bin_header_data& header)
+{
+    return (is_segy_rev2(header) && header.extended_samples_per_trace > 0) ? header.extended_samples_per_trace
+                                                                            : header.samples_per_trace;
+}
+
+// Sample interval in microseconds
+inline double segy_sample_interval(const segy_bin_header_data& header)
+{
+    return (is_segy_rev2(header) && header.extended_sample_interval > 0.0) ? header.extended_sample_interval
+                                                                            : header.sample_interval;
+}
+
+// Number of traces the header declares
+inline size_t segy_declared_num_traces(const segy_bin_header_data& header)
+{
+    if (is_segy_rev2(header) && header.num_of_traces_in_file > 0)
+        return header.num_of_traces_in_file;
+    if (is_segy_rev2(header) && header.extended_num_of_traces_per_record > 0)
+        return header.extended_num_of_traces_per_record;
+    return header.num_of_traces_per_record;
+}
+
+// Offset of the first trace, after the extended text headers if there are any
+inline uint64 segy_data_offset(const segy_bin_header_data& header)
+{
+    if (is_segy_rev2(header) && header.first_trace_offset > 0)
+        return header.first_trace_offset;
+    // 0xFFFF means a variable number of extended headers, which isn't supported
+    if (header.segy_revision >= 0x0100 && header.num_of_extended_text_headers != 0xFFFF)
+        return SEGY_DATA_OFFSET + uint64(SEGY_TEXT_HEADER_SIZE) * header.num_of_extended_text_headers;
+    return SEGY_DATA_OFFSET;
+}
+
+inline void set_segy_samples_per_trace(segy_bin_header_data& header, size_t num_of_samples)
+{
+    if (num_of_samples > SEGY_MAX_SHORT_COUNT)
+        make_segy_rev2(header);
+    header.samples_per_trace = (num_of_samples > SEGY_MAX_SHORT_COUNT) ? 0 : num_of_samples;
+    header.samples_per_trace_reel = header.samples_per_trace;
+    if (is_segy_rev2(header))
+        header.extended_samples_per_trace = num_of_samples;
+}
+
+inline void set_segy_num_traces(segy_bin_header_data& header, size_t num_of_traces)
+{
+    if (num_of_traces > SEGY_MAX_SHORT_COUNT)
+        make_segy_rev2(header);
+    header.num_of_traces_per_record = (num_of_traces > SEGY_MAX_SHORT_COUNT) ? 0 : num_of_traces;
+    if (is_segy_rev2(header))
+    {
+        header.extended_num_of_traces_per_record = num_of_traces;
+        header.num_of_traces_in_file = num_of_traces;
+    }
+}
+
+// Sets the interval rounded to whole microseconds, or exactly in rev2 if it doesn't fit 16 bits
+inline void set_segy_sample_interval(segy_bin_header_data& header, double microseconds)
+{
+    double rounded = floor(microseconds + 0.5);
+    if (rounded > SEGY_MAX_SHORT_COUNT)
+        make_segy_rev2(header);
+    header.sample_interval = (rounded > SEGY_MAX_SHORT_COUNT) ? 0 : uint16(rounded);
+    header.sample_interval_reel = header.sample_interval;
+    if (is_segy_rev2(header))
+        header.extended_sample_interval = (rounded > SEGY_MAX_SHORT_COUNT) ? microseconds : rounded;
+}
+
+// Number of samples of a trace header, 0 if it doesn't fit 16 bits
+inline uint16 segy_trace_num_of_samples(size_t num_of_samples)
+{
+    return (num_of_samples > SEGY_MAX_SHORT_COUNT) ? 0 : num_of_samples;
+}
+
+// Size of a trace record (header and samples) of a file with the given binary header
+inline size_t segy_trace_size(const segy_bin_header_data& header)
+{
+    return sizeof(segy_trace_header) + sizeof(float) * size_t(segy_samples_per_trace(header));
+}
+
+// Rev0 files often have garbage where rev1 keeps the number of extended text headers (and rev2
+// the first trace offset). A data offset after which the declared traces don't fit the file,
+// while they would fit from SEGY_DATA_OFFSET or the offset is past the end, is dropped.
+inline void check_segy_data_offset(segy_bin_header_data& header, uint64 file_size)
+{
+    const uint64 data_offset = segy_data_offset(header);
+    const uint64 traces_size = uint64(segy_declared_num_traces(header)) * segy_trace_size(header);
+    if (data_offset == SEGY_DATA_OFFSET || data_offset + traces_size <= file_size)
+        return;
+    if (data_offset >= file_size || SEGY_DATA_OFFSET + traces_size <= file_size)
+    {
+        header.num_of_extended_text_headers = 0;
+        if (is_segy_rev2(header))
+            header.first_trace_offset = 0;
+    }
+}
+
+// Traces that fit into a file of file_size bytes, the trace count follows
+// from the file size; compare with segy_declared_num_traces to find truncated files
+inline IndexType segy_num_traces(const segy_bin_header_data& header, uint64 file_size)
+{
+    const uint64 data_offset = segy_data_offset(header);
+    return (file_size > data_offset) ? (file_size - data_offset) / segy_trace_size(header) : 0;
+}
+
+// Binary header of the SEG-Y files this program creates
+segy_bin_header_data make_segy_bin_header(size_t num_of_traces, size_t num_of_samples, double sample_interval,
+                                          int sample_format);
+
+// Trace header of receiver i of the SEG-Y files this program creates
+template <typename Scalar>
+segy_trace_header make_segy_trace_header(IndexType i, Scalar rec_x, Scalar rec_y, Scalar source_x, Scalar source_y,
+                                         const segy_bin_header_data& bin_header)
+{
+    segy_trace_header header;
+    memset(&header, 0, sizeof(header));
+    header.trace_seq_num_line = i;
+    header.trace_seq_num_reel = i;
+    header.trace_id_code = i;
+    header.receiver_x = rec_x;
+    header.receiver_y = rec_y;
+    header.source_x = source_x;
+    header.source_y = source_y;
+    header.field_record_num = 1;
+    header.num_of_samples = segy_trace_num_of_samples(segy_samples_per_trace(bin_header));
+    header.sample_interval = bin_header.sample_interval;
+    header.trace_num_reel = 1;
+    header.units_id = 1;
+    header.distance_from_source =
+            uint32(sqrt(Scalar((rec_x-source_x)*(rec_x-source_x) + (rec_y-source_y)*(rec_y-source_y)) + 0.5));
+    return header;
+}
+
+// Samples of one trace inside a mapped SEG-Y file.
+// Nothing is copied; samples are converted to native byte order when accessed.
+class SegYTraceView
+{
+public:
+
+    SegYTraceView(const char * raw, IndexType num_samples, int format) : raw(raw), num_samples(num_samples), format(format) {}
+
+    float operator[](IndexType i) const
+    {
+        if (format == SEGY_FORMAT_IBM_FLOAT)
+            return ibm_to_ieee(load_big_endian<uint32>(raw + i * sizeof(float)));
+        return load_big_endian<float>(raw + i * sizeof(float));
+    }
+    IndexType size() const { return num_samples; }
+    const char* RawData() const { return raw; }
+
+    // Converts all samples to native floats into dst
+    void CopyTo(float * dst) const
+    {
+        decode_samples(raw, dst, num_samples, format);
+    }
+    // Converts count samples starting from first into dst
+    void CopyTo(float * dst, IndexType first, IndexType count) const
+    {
+        decode_samples(raw + size_t(first) * sizeof(float), dst, count, format);
+    }
+
+private:
+
+    const char * raw;
+    IndexType num_samples;
+    int format;
+};
+
+// Zero-copy view of a SEG-Y file backed by mmap.
+// Only the binary header is decoded on Open, trace headers and samples are
+// swapped on access.
+class SegYFileView
+{
+public:
+
+    SegYFileView() : num_traces(0), trace_size(0), data_offset(SEGY_DATA_OFFSET) {}
+
+    // Returns false if the file can't be mapped or is too small to be a SEG-Y file.
+    // Check is_supported_sample_format(BinaryHeader().data_sample_format) before reading samples.
+    bool Open(const std::string& path);
+    void Close();
+    // Drops the pages read so far, keeps resident memory bounded while streaming
+    void Release() { file.Release(); }
+
+    const segy_bin_header_data& BinaryHeader() const { return header; }
+    IndexType NumTraces() const { return num_traces; }
+    IndexType NumSamples() const { return segy_samples_per_trace(header); }
+    // false if the file holds fewer traces than the binary header promises
+    bool IsComplete() const { return num_traces >= segy_declared_num_traces(header); }
+
+    const char* RawTraceHeader(IndexType i) const { return file.Data() + data_offset + size_t(i) * trace_size; }
+    segy_trace_header TraceHeader(IndexType i) const;
+    SegYTraceView Trace(IndexType i) const
+    {
+        return SegYTraceView(RawTraceHeader(i) + sizeof(segy_trace_header), NumSamples(), header.data_sample_format);
+    }
+
+private:
+
+    MappedFile file;
+    segy_bin_header_data header;
+    IndexType num_traces;
+    size_t trace_size;
+    size_t data_offset;
+};
+
+#endif // SEGY_FILE_H
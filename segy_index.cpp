@@ -0,0 +1,168 @@
+#include "segy_index.h"
+#include "segy_file.h"
+#include "read_ahead.h"
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string.h>
+#include <stdio.h>
+#include <stddef.h>
+#include <sys/stat.h>
+
+// First bytes of an index file, the last one is the version of the format
+#define SEGY_INDEX_MAGIC "SEGYIDX\x02"
+#define SEGY_INDEX_MAGIC_SIZE 8
+
+// Beginning of an index file, entries follow it. Everything is in native byte order.
+struct segy_index_file_header
+{
+    char magic[SEGY_INDEX_MAGIC_SIZE];
+    // The SEG-Y file the index was built for
+    uint64_t segy_size;
+    int64_t segy_mtime_sec;
+    int64_t segy_mtime_nsec;
+    uint64_t num_traces;
+    segy_bin_header_data bin_header;
+};
+
+// Size and modification time of a file, false if there is no such file
+bool segy_file_stamp(const std::string& path, segy_index_file_header& header)
+{
+    struct stat st;
+    if (::stat(path.c_str(), &st) != 0)
+        return false;
+    header.segy_size = st.st_size;
+    header.segy_mtime_sec = st.st_mtim.tv_sec;
+    header.segy_mtime_nsec = st.st_mtim.tv_nsec;
+    return true;
+}
+
+void SegYIndex::Open(const std::string& segy_path)
+{
+    const std::string index_path = segy_index_path(segy_path);
+    if (Load(index_path, segy_path))
+        return;
+    Build(segy_path);
+    Save(index_path);
+}
+
+void SegYIndex::Build(const std::string& segy_path)
+{
+    SegYFileView file;
+    if (!file.Open(segy_path))
+        throw std::runtime_error("Error in reading SEG-Y file.\nThere is no such file: " + segy_path);
+    if (!file.IsComplete())
+    {
+        std::cout << "Warning: SEG-Y file " << segy_path << " is truncated, only "
+                  << file.NumTraces() << " traces have been indexed" << std::endl;
+    }
+    bin_header = file.BinaryHeader();
+    set_segy_num_traces(bin_header, file.NumTraces());
+
+    // Only the trace headers are read, with pread at the trace offsets: through the
+    // mapping the kernel read-ahead would pull in the samples of the whole file
+    ReadAheadFile headers_file(READ_AHEAD_ALIGNMENT, 1, 1);
+    if (!headers_file.Open(segy_path))
+        throw std::runtime_error("Error in reading SEG-Y file.\nThere is no such file: " + segy_path);
+    StatsTimer timer(STATS_LOAD, uint64(file.NumTraces()) * sizeof(segy_trace_header), 0);
+    entries.resize(file.NumTraces());
+    char raw[sizeof(segy_trace_header)];
+    for (IndexType i = 0; i < file.NumTraces(); i++)
+    {
+        segy_index_entry& entry = entries[i];
+        entry.offset = segy_data_offset(bin_header) + uint64(i) * segy_trace_size(bin_header);
+        headers_file.ReadAt(entry.offset, raw, sizeof(raw));
+        entry.trace_seq_num_line = load_big_endian<uint32>(raw + offsetof(segy_trace_header, trace_seq_num_line));
+        entry.receiver_x = load_big_endian<uint32>(raw + offsetof(segy_trace_header, receiver_x));
+        entry.receiver_y = load_big_endian<uint32>(raw + offsetof(segy_trace_header, receiver_y));
+        entry.source_x = load_big_endian<uint32>(raw + offsetof(segy_trace_header, source_x));
+        entry.source_y = load_big_endian<uint32>(raw + offsetof(segy_trace_header, source_y));
+        entry.distance_from_source = load_big_endian<uint32>(raw + offsetof(segy_trace_header, distance_from_source));
+    }
+    built_path = segy_path;
+}
+
+void SegYIndex::Save(const std::string& index_path) const
+{
+    segy_index_file_header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SEGY_INDEX_MAGIC, SEGY_INDEX_MAGIC_SIZE);
+    if (!segy_file_stamp(built_path, header))
+        throw std::runtime_error("Error in writing SEG-Y index " + index_path + ": no SEG-Y file " + built_path);
+    header.num_traces = entries.size();
+    header.bin_header = bin_header;
+
+    // Written next to the final name and renamed, so that readers never see a partial index
+    const std::string temp_path = index_path + ".tmp";
+    std::ofstream outf(temp_path.c_str(), std::ios::out | std::ios::binary);
+    outf.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    outf.write(reinterpret_cast<const char*>(entries.data()), entries.size() * sizeof(segy_index_entry));
+    outf.close();
+    if (!outf || ::rename(temp_path.c_str(), index_path.c_str()) != 0)
+    {
+        ::remove(temp_path.c_str());
+        throw std::runtime_error("Error in writing SEG-Y index: " + index_path);
+    }
+}
+
+bool SegYIndex::Load(const std::string& index_path, const std::string& segy_path)
+{
+    std::ifstream inf(index_path.c_str(), std::ios::in | std::ios::binary);
+    segy_index_file_header header, stamp;
+    if (!inf || !inf.read(reinterpret_cast<char*>(&header), sizeof(header)))
+        return false;
+    if (memcmp(header.magic, SEGY_INDEX_MAGIC, SEGY_INDEX_MAGIC_SIZE) != 0 || !segy_file_stamp(segy_path, stamp))
+        return false;
+    // An index of another version of the file is stale
+    if (header.segy_size != stamp.segy_size || header.segy_mtime_sec != stamp.segy_mtime_sec ||
+        header.segy_mtime_nsec != stamp.segy_mtime_nsec)
+        return false;
+
+    std::vector<segy_index_entry> loaded(header.num_traces);
+    if (!inf.read(reinterpret_cast<char*>(loaded.data()), loaded.size() * sizeof(segy_index_entry)))
+        return false;
+    entries.swap(loaded);
+    bin_header = header.bin_header;
+    built_path = segy_path;
+    return true;
+}
+
+std::vector<IndexType> SegYIndex::FindByReceiver(uint32 x_min, uint32 x_max, uint32 y_min, uint32 y_max) const
+{
+    std::vector<IndexType> traces;
+    for (IndexType i = 0; i < entries.size(); i++)
+    {
+        const segy_index_entry& entry = entries[i];
+        if (entry.receiver_x >= x_min && entry.receiver_x <= x_max &&
+            entry.receiver_y >= y_min && entry.receiver_y <= y_max)
+            traces.push_back(i);
+    }
+    return traces;
+}
+
+std::vector<IndexType> SegYIndex::FindByOffset(uint32 min_offset, uint32 max_offset) const
+{
+    std::vector<IndexType> traces;
+    for (IndexType i = 0; i < entries.size(); i++)
+    {
+        if (entries[i].distance_from_source >= min_offset && entries[i].distance_from_source <= max_offset)
+            traces.push_back(i);
+    }
+    return traces;
+}
+
+std::vector<IndexType> SegYIndex::Find(const SegYTraceQuery& query) const
+{
+    std::vector<IndexType> traces;
+    for (IndexType i = 0; i < entries.size(); i++)
+    {
+        const segy_index_entry& entry = entries[i];
+        if (query.by_receiver && (entry.receiver_x < query.receiver_x_min || entry.receiver_x > query.receiver_x_max ||
+                                  entry.receiver_y < query.receiver_y_min || entry.receiver_y > query.receiver_y_max))
+            continue;
+        if (query.by_offset && (entry.distance_from_source < query.min_offset || entry.distance_from_source > query.max_offset))
+            continue;
+        traces.push_back(i);
+    }
+    return traces;
+}
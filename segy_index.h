@@ -0,0 +1,69 @@
+#ifndef SEGY_INDEX_H
+#define SEGY_INDEX_H
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <string.h>
+#include "seismogram.h"
+
+// Trace header fields kept in the index, with the position of the trace
+struct segy_index_entry
+{
+    uint32 trace_seq_num_line;
+    uint32 receiver_x;
+    uint32 receiver_y;
+    uint32 source_x;
+    uint32 source_y;
+    uint32 distance_from_source;
+    // Byte offset of the trace header in the SEG-Y file
+    uint64_t offset;
+};
+
+// Index of the trace headers of a SEG-Y file, kept in a sidecar file
+// <segy file>.idx. Building it reads only the trace headers; the sidecar
+// remembers the size and modification time of the SEG-Y file and is
+// rebuilt when they change. Queries return trace numbers for
+// Seismogramm::LoadSegYTraces, which reads just those traces.
+class SegYIndex
+{
+public:
+
+    SegYIndex() { memset(&bin_header, 0, sizeof(bin_header)); }
+
+    // Loads the sidecar if it is up to date, otherwise builds the index and saves it.
+    // Throws std::runtime_error if the SEG-Y file can't be read.
+    void Open(const std::string& segy_path);
+    // Scans the trace headers of a SEG-Y file
+    void Build(const std::string& segy_path);
+    void Save(const std::string& index_path) const;
+    // Returns false if there is no index or it doesn't describe segy_path as it is now
+    bool Load(const std::string& index_path, const std::string& segy_path);
+
+    const std::vector<segy_index_entry>& Entries() const { return entries; }
+    IndexType NumTraces() const { return entries.size(); }
+    // Binary header of the SEG-Y file (native byte order), num_of_traces_per_record is the number of indexed traces
+    const segy_bin_header_data& BinaryHeader() const { return bin_header; }
+
+    // Traces with receivers inside [x_min, x_max] x [y_min, y_max]
+    std::vector<IndexType> FindByReceiver(uint32 x_min, uint32 x_max, uint32 y_min, uint32 y_max) const;
+    // Traces with distance_from_source inside [min_offset, max_offset]
+    std::vector<IndexType> FindByOffset(uint32 min_offset, uint32 max_offset) const;
+    // Traces matching all the ranges the query sets
+    std::vector<IndexType> Find(const SegYTraceQuery& query) const;
+
+private:
+
+    // The SEG-Y file the entries describe
+    std::string built_path;
+    segy_bin_header_data bin_header;
+    std::vector<segy_index_entry> entries;
+};
+
+// Name of the sidecar index of a SEG-Y file
+inline std::string segy_index_path(const std::string& segy_path)
+{
+    return segy_path + ".idx";
+}
+
+#endif // SEGY_INDEX_H
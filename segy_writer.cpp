@@ -0,0 +1,182 @@
+#include "segy_writer.h"
+#include "segy_file.h"
+#include "transpose.h"
+#include "stats.h"
+#include <stdexcept>
+#include <algorithm>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+SegYStreamWriter::SegYStreamWriter(size_t max_memory) :
+    max_memory(max_memory), fd(-1), num_of_receivers(0), max_num_of_times(0), sample_format(SEGY_FORMAT_IEEE_FLOAT),
+    source_x(0), source_y(0), num_of_steps(0), block_steps(0), block_begin(0)
+{
+    first_times[0] = first_times[1] = 0;
+}
+
+SegYStreamWriter::~SegYStreamWriter()
+{
+    if (fd >= 0)
+        ::close(fd);
+}
+
+void SegYStreamWriter::Open(const std::string& path, IndexType num_of_receivers, size_t max_num_of_times, int sample_format)
+{
+    if (fd >= 0)
+        ::close(fd);
+    this->path = path;
+    this->num_of_receivers = num_of_receivers;
+    this->max_num_of_times = max_num_of_times;
+    this->sample_format = sample_format;
+    rec_x.clear();
+    rec_y.clear();
+    source_x = source_y = 0;
+    num_of_steps = 0;
+    block_begin = 0;
+
+    fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0 || ::ftruncate(fd, trace_offset(num_of_receivers, max_num_of_times)) != 0)
+    {
+        throw std::runtime_error("Error in writing SEG-Y file: " + path + ": " + strerror(errno));
+    }
+
+    // A block holds the samples of block_steps time steps of every receiver, once as
+    // floats and once encoded
+    const size_t step_bytes = 2 * sizeof(float) * std::max<size_t>(num_of_receivers, 1);
+    block_steps = std::max<size_t>(1, std::min(max_num_of_times, max_memory / step_bytes));
+    block.resize(size_t(num_of_receivers) * block_steps);
+    encoded.resize(sizeof(float) * block.size());
+}
+
+void SegYStreamWriter::SetPositions(const std::vector<float>& rec_x, const std::vector<float>& rec_y,
+                                    float source_x, float source_y)
+{
+    this->rec_x = rec_x;
+    this->rec_y = rec_y;
+    this->source_x = source_x;
+    this->source_y = source_y;
+}
+
+void SegYStreamWriter::AddTimeSteps(const float * steps, size_t num_of_steps, const float * times)
+{
+    if (this->num_of_steps + num_of_steps > max_num_of_times)
+    {
+        throw std::runtime_error("Error in writing SEG-Y file " + path + ": more time steps than the file was created for");
+    }
+    for (size_t i = 0; i < num_of_steps && this->num_of_steps + i < 2; i++)
+        first_times[this->num_of_steps + i] = times[i];
+
+    // Steps are transposed into the traces of the block, which is written once it is full
+    while (num_of_steps > 0)
+    {
+        const size_t filled = this->num_of_steps - block_begin;
+        const size_t count = std::min(num_of_steps, block_steps - filled);
+        transpose(steps, num_of_receivers, block.data() + filled, block_steps, count, num_of_receivers);
+        steps += count * num_of_receivers;
+        num_of_steps -= count;
+        this->num_of_steps += count;
+        if (this->num_of_steps - block_begin == block_steps)
+            write_block();
+    }
+}
+
+void SegYStreamWriter::write_block()
+{
+    const size_t filled = num_of_steps - block_begin;
+    if (filled == 0)
+        return;
+    encode_samples(block.data(), encoded.data(), block.size(), sample_format);
+    for (IndexType i = 0; i < num_of_receivers; i++)
+    {
+        uint64 offset = trace_offset(i, max_num_of_times) + sizeof(segy_trace_header) + sizeof(float) * block_begin;
+        write_at(&encoded[sizeof(float) * block_steps * i], sizeof(float) * filled, offset);
+    }
+    block_begin = num_of_steps;
+}
+
+void SegYStreamWriter::Finish()
+{
+    if (fd < 0)
+        return;
+    write_block();
+
+    // Traces are moved towards the beginning of the file one after another,
+    // a trace never overwrites samples that haven't been moved yet
+    if (num_of_steps < max_num_of_times)
+    {
+        std::vector<char> samples(sizeof(float) * num_of_steps);
+        for (IndexType i = 1; i < num_of_receivers && !samples.empty(); i++)
+        {
+            read_at(samples.data(), samples.size(), trace_offset(i, max_num_of_times) + sizeof(segy_trace_header));
+            write_at(samples.data(), samples.size(), trace_offset(i, num_of_steps) + sizeof(segy_trace_header));
+        }
+        if (::ftruncate(fd, trace_offset(num_of_receivers, num_of_steps)) != 0)
+        {
+            throw std::runtime_error("Error in writing SEG-Y file: " + path + ": " + strerror(errno));
+        }
+    }
+
+    // Headers
+    const float interval = (num_of_steps > 1) ? first_times[1] - first_times[0] : 0;
+    segy_bin_header_data header = make_segy_bin_header(num_of_receivers, num_of_steps, interval * 1000000.0, sample_format);
+    segy_bin_header_data big_endian_header = header;
+    swap_segy_bin_header(big_endian_header);
+    std::vector<char> text_header(SEGY_TEXT_HEADER_SIZE, 0);
+    write_at(text_header.data(), text_header.size(), 0);
+    write_at(&big_endian_header, sizeof(big_endian_header), SEGY_TEXT_HEADER_SIZE);
+    for (IndexType i = 0; i < num_of_receivers; i++)
+    {
+        segy_trace_header trace_header = make_segy_trace_header(i, i < rec_x.size() ? rec_x[i] : 0.0f,
+                                                                i < rec_y.size() ? rec_y[i] : 0.0f,
+                                                                source_x, source_y, header);
+        swap_segy_trace_header(trace_header);
+        write_at(&trace_header, sizeof(trace_header), trace_offset(i, num_of_steps));
+    }
+
+    int result = ::close(fd);
+    fd = -1;
+    if (result != 0)
+    {
+        throw std::runtime_error("Error in writing SEG-Y file: " + path + ": " + strerror(errno));
+    }
+}
+
+uint64 SegYStreamWriter::trace_offset(IndexType i, size_t num_of_samples) const
+{
+    return SEGY_DATA_OFFSET + uint64(i) * (sizeof(segy_trace_header) + sizeof(float) * num_of_samples);
+}
+
+void SegYStreamWriter::write_at(const void * data, size_t count, uint64 offset)
+{
+    StatsTimer timer(STATS_WRITE, count, 0);
+    const char * in = static_cast<const char*>(data);
+    while (count > 0)
+    {
+        ssize_t done = ::pwrite(fd, in, count, offset);
+        if (done < 0 && errno == EINTR)
+            continue;
+        if (done <= 0)
+            throw std::runtime_error("Error in writing SEG-Y file: " + path + ": " + strerror(errno));
+        in += done;
+        offset += done;
+        count -= done;
+    }
+}
+
+void SegYStreamWriter::read_at(void * data, size_t count, uint64 offset)
+{
+    char * out = static_cast<char*>(data);
+    while (count > 0)
+    {
+        ssize_t done = ::pread(fd, out, count, offset);
+        if (done < 0 && errno == EINTR)
+            continue;
+        if (done <= 0)
+            throw std::runtime_error("Error in reading SEG-Y file: " + path + ": " + (done < 0 ? strerror(errno) : "unexpected end of file"));
+        out += done;
+        offset += done;
+        count -= done;
+    }
+}
@@ -0,0 +1,72 @@
+#ifndef SEGY_WRITER_H
+#define SEGY_WRITER_H
+
+#include <string>
+#include <vector>
+#include <cstddef>
+#include "seismogram.h"
+
+// Writes a SEG-Y file while its samples arrive one time step at a time,
+// e.g. during a simulation. The file is created at its full size up front;
+// time steps are collected into a bounded block per receiver, and each
+// block is written straight to its place inside the trace. Finish writes
+// the binary and trace headers, so memory use doesn't depend on the number
+// of time steps. Errors are reported by std::runtime_error.
+class SegYStreamWriter
+{
+public:
+
+    // Samples are buffered in at most max_memory bytes
+    explicit SegYStreamWriter(size_t max_memory = 64 * 1024 * 1024);
+    ~SegYStreamWriter();
+
+    // Creates a file for num_of_receivers traces of up to max_num_of_times samples
+    // of the given format (1 - IBM, 5 - IEEE)
+    void Open(const std::string& path, IndexType num_of_receivers, size_t max_num_of_times, int sample_format = 5);
+    // Positions written into the trace headers, zero if not set
+    void SetPositions(const std::vector<float>& rec_x, const std::vector<float>& rec_y, float source_x, float source_y);
+
+    // Records num_of_steps time steps: steps[i * NumReceivers() + j] is the sample of receiver j at times[i].
+    // Time steps are expected to be equidistant, the interval is taken from the first two.
+    void AddTimeSteps(const float * steps, size_t num_of_steps, const float * times);
+    void AddTimeStep(float time, const float * values) { AddTimeSteps(values, 1, &time); }
+
+    // Writes the rest of the samples and the headers and closes the file. If fewer
+    // time steps than max_num_of_times have been recorded, the traces are moved
+    // together and the file is shortened.
+    void Finish();
+
+    IndexType NumReceivers() const { return num_of_receivers; }
+    size_t NumTimeSteps() const { return num_of_steps; }
+
+private:
+
+    SegYStreamWriter(const SegYStreamWriter&);
+    SegYStreamWriter& operator=(const SegYStreamWriter&);
+
+    // Writes the buffered block of every receiver to its trace
+    void write_block();
+    void write_at(const void * data, size_t count, uint64 offset);
+    void read_at(void * data, size_t count, uint64 offset);
+    // Offset of the header of trace i in a file with traces of num_of_samples samples
+    uint64 trace_offset(IndexType i, size_t num_of_samples) const;
+
+    size_t max_memory;
+    std::string path;
+    int fd;
+    IndexType num_of_receivers;
+    size_t max_num_of_times;
+    int sample_format;
+    std::vector<float> rec_x, rec_y;
+    float source_x, source_y;
+    float first_times[2];
+
+    size_t num_of_steps;
+    // Samples of block_steps time steps per receiver, trace-major, starting from step block_begin
+    size_t block_steps;
+    size_t block_begin;
+    std::vector<float> block;
+    std::vector<char> encoded;
+};
+
+#endif // SEGY_WRITER_H
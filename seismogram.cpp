@@ -1,157 +1,618 @@
 #include "seismogram.h"
+#include "segy_file.h"
+#include "csv_reader.h"
+#include "parallel.h"
+#include "resample.h"
+#include "csv_writer.h"
+#include "transpose.h"
+#include "mapped_file.h"
+#include "read_ahead.h"
+#include "npy_file.h"
+#include "segy_index.h"
+#include "segy_writer.h"
+#include "trace_runs.h"
+#include "gzip_file.h"
+#include "stats.h"
 #include <vector>
 #include <string>
-#include <sstream>
 #include <fstream>
+#include <sstream>
+#include <stdexcept>
 #include <iostream>
 #include <climits>
+#include <string.h>
 #include <algorithm>
+#include <memory>
+#include <atomic>
+#include <functional>
+#include <future>
+#include <stdint.h>
 #include <math.h>
 
 
-template <typename T>
-void swap_endian(T& pX)
+// Throws if samples of the given format can't be read
+void check_sample_format(int format, const std::string& path)
 {
-    // should static assert that T is a POD
-    char& raw = reinterpret_cast<char&>(pX);
-    std::reverse(&raw, &raw + sizeof(T));
+    if (!is_supported_sample_format(format))
+    {
+        std::ostringstream message;
+        message << "Error in reading SEG-Y file " << path << "\nUnsupported data sample format: "
+                << format << " (only IBM (1) and IEEE (5) floats are supported)";
+        throw std::runtime_error(message.str());
+    }
 }
 
-template <typename T>
-T swap_endian_copy(T pX)
+// Opens a SEG-Y file for reading samples, throws if it can't be done
+void open_segy_file(SegYFileView& file, const std::string& path)
 {
-    swap_endian(pX);
-    return pX;
+    if (!file.Open(path))
+        throw std::runtime_error("Error in reading SEG-Y file.\nThere is no such file: " + path);
+    check_sample_format(file.BinaryHeader().data_sample_format, path);
 }
 
-std::vector<std::string> getNextLineAndSplitIntoTokens(std::istream& str, char delim = ';')
+void warn_truncated_segy_file(const std::string& path, IndexType num_of_traces)
 {
-    std::vector<std::string>   result;
-    std::string                line;
-    std::getline(str,line);
+    std::cout << "Warning: SEG-Y file " << path << " is truncated, only "
+              << num_of_traces << " traces have been read" << std::endl;
+}
 
-    std::stringstream          lineStream(line);
-    std::string                cell;
+// Opens a CSV file for writing numbers in the given format, throws if it can't be done
+void open_csv_file(CsvWriter& outf, const std::string& path, const CsvNumberFormat& format, int num_threads)
+{
+    if (!outf.Open(path, num_threads))
+        throw std::runtime_error("Error in writing CSV file: " + path);
+    outf.SetNumberFormat(format);
+}
 
-    while(std::getline(lineStream,cell, delim))
+void close_csv_file(CsvWriter& outf, const std::string& path)
+{
+    if (!outf.Close())
+        throw std::runtime_error("Error in writing CSV file: " + path);
+}
+
+void write_csv_header(CsvWriter& outf, IndexType num_of_receivers, int dims)
+{
+    outf.Write("Time;");
+    for (IndexType i = 0; i < num_of_receivers; i++)
     {
-        result.push_back(cell);
+        const int edge = i + 1;
+        outf.Write("Vx (edge = "); outf.Write(edge); outf.Write(");");
+        outf.Write("Vy (edge = "); outf.Write(edge); outf.Write(");");
+        if (dims >= 3)
+        {
+            outf.Write("Vz (edge = "); outf.Write(edge); outf.Write(");");
+        }
     }
-    return result;
+    outf.Write('\n');
 }
 
-// |||||||||||||||||||||||||||||||||||||||||||||||||||||||||||||||||||||||| \\
-// |||||||||||||||||||||||| Seismogramm ||||||||||||||||||||||||||||||||||| \\
-// |||||||||||||||||||||||||||||||||||||||||||||||||||||||||||||||||||||||| \\
+// Bytes of CSV text parsed by one task
+#define CSV_CHUNK_SIZE (4 * 1024 * 1024)
+
+// Time steps moved between trace-major and time-major layouts at once
+#define CSV_TIME_BLOCK 64
 
+// Writes num_of_rows CSV rows from time-major tiles, one per component:
+// tiles[k][i * num_of_receivers + j] is the sample of receiver j at times[i]
+template <typename Scalar>
+void write_csv_rows(CsvWriter& outf, const Scalar * times, const Scalar * const * tiles,
+                    IndexType num_of_rows, IndexType num_of_receivers, int dims)
+{
+    for (IndexType i = 0; i < num_of_rows; i++)
+    {
+        outf.Write(times[i]); outf.Write(';');
+        size_t row_offset = size_t(i) * num_of_receivers;
+        for (IndexType j = 0; j < num_of_receivers; j++)
+        {
+            for (int k = 0; k < dims; k++)
+            {
+                outf.Write(tiles[k][row_offset + j]); outf.Write(';');
+            }
+        }
+        outf.Write('\n');
+    }
+}
 
+// Approximate amount of CSV text formatted by one task
+#define CSV_FORMAT_BLOCK_SIZE (1024 * 1024)
 
-template<typename Scalar>
-void Seismogramm<Scalar>::swap_header_endian()
+// Rows of row_size values formatted by one task, at most CSV_TIME_BLOCK
+IndexType csv_rows_per_block(size_t row_size)
 {
-    swap_endian<uint32>(header_data.job_id);
-    swap_endian<uint32>(header_data.line_num);
-    swap_endian<uint32>(header_data.reel_num);
-    swap_endian<uint16>(header_data.num_of_traces_per_record);
-    swap_endian<uint16>(header_data.num_of_auxiliary_traces_per_record);
-    swap_endian<uint16>(header_data.sample_interval_reel);
-    swap_endian<uint16>(header_data.sample_interval);
-    swap_endian<uint16>(header_data.samples_per_trace_reel);
-    swap_endian<uint16>(header_data.samples_per_trace);
-    swap_endian<uint16>(header_data.data_sample_format);
+    size_t row_text = 16 * (row_size + 1);
+    return std::max<size_t>(1, std::min<size_t>(CSV_TIME_BLOCK, CSV_FORMAT_BLOCK_SIZE / row_text));
 }
 
-template<typename Scalar>
-void Seismogramm<Scalar>::swap_trace_header_endian(struct segy_trace_header * ptr_header)
-{
-    swap_endian<uint32>(ptr_header->trace_seq_num_line);
-    swap_endian<uint32>(ptr_header->trace_seq_num_reel);
-    swap_endian<uint32>(ptr_header->field_record_num);
-    swap_endian<uint32>(ptr_header->trace_num_reel);
-    swap_endian<uint16>(ptr_header->trace_id_code);
-    swap_endian<uint32>(ptr_header->source_x);
-    swap_endian<uint32>(ptr_header->source_y);
-    swap_endian<uint32>(ptr_header->receiver_x);
-    swap_endian<uint32>(ptr_header->receiver_y);
-    swap_endian<uint16>(ptr_header->units_id);
-    swap_endian<uint16>(ptr_header->num_of_samples);
-    swap_endian<uint16>(ptr_header->sample_interval);
-    swap_endian<uint32>(ptr_header->distance_from_source);
-    swap_endian<uint16>(ptr_header->num_of_verticaly_summed_traces);
-    swap_endian<uint16>(ptr_header->num_of_horizotally_summed_traces);
-    swap_endian<uint16>(ptr_header->data_use);
+// Formats num_of_rows rows on up to num_threads threads and writes them to
+// outf in order. format_rows(begin, end, out) formats rows [begin, end) into
+// out; blocks of rows_per_block rows are formatted into separate buffers,
+// at most two per thread, and written out once the whole wave is done.
+void write_csv_blocks(CsvWriter& outf, IndexType num_of_rows, IndexType rows_per_block, int num_threads,
+                      const std::function<void(IndexType, IndexType, CsvWriter&)>& format_rows)
+{
+    size_t threads = (num_threads > 0) ? num_threads : default_num_threads();
+    size_t num_of_blocks = (size_t(num_of_rows) + rows_per_block - 1) / rows_per_block;
+    std::vector<std::unique_ptr<CsvWriter> > blocks(std::min(num_of_blocks, 2 * threads));
+    for (size_t i = 0; i < blocks.size(); i++)
+    {
+        blocks[i].reset(new CsvWriter(CSV_FORMAT_BLOCK_SIZE));
+        blocks[i]->SetNumberFormat(outf.NumberFormat());
+    }
+    for (size_t wave_begin = 0; wave_begin < num_of_blocks; wave_begin += blocks.size())
+    {
+        size_t wave_size = std::min(blocks.size(), num_of_blocks - wave_begin);
+        parallel_for(wave_size, num_threads, [&](size_t i)
+        {
+            IndexType begin = (wave_begin + i) * rows_per_block;
+            IndexType end = std::min<size_t>(num_of_rows, size_t(begin) + rows_per_block);
+            StatsTimer timer(STATS_FORMAT);
+            blocks[i]->Clear();
+            format_rows(begin, end, *blocks[i]);
+            timer.Add(blocks[i]->Size(), 0);
+        });
+        for (size_t i = 0; i < wave_size; i++)
+            outf.Write(blocks[i]->Data(), blocks[i]->Size());
+    }
 }
 
-template<typename Scalar>
-void Seismogramm<Scalar>::swap_all_trace_headers_endian()
+// Bytes of decompressed text of .csv.gz files parsed at once
+#define CSV_GZIP_BLOCK_SIZE (32 * 1024 * 1024)
+
+// Calls block(begin, end) for consecutive pieces of whole lines of the CSV file at path until
+// it returns false; the first piece starts with the header line. A plain file is mapped and
+// split into pieces of about block_size bytes, whose pages are dropped once they are parsed.
+// A .gz file is decompressed by a background thread while the previous piece is parsed.
+void for_each_csv_block(const std::string& path, size_t block_size, const std::function<bool(const char*, const char*)>& block)
 {
-    for (IndexType i = 0; i < trace_header_data.size(); i++)
-        swap_trace_header_endian(&trace_header_data[i]);
+    if (is_gzip_path(path))
+    {
+        GzipReader reader;
+        if (!reader.Open(path))
+        {
+            throw std::runtime_error("Error in reading CSV file.\nThere is no such file: " + path);
+        }
+        std::vector<char> text, next;
+        bool has_text = reader.ReadLines(text, block_size);
+        bool more = true;
+        while (more)
+        {
+            std::future<bool> next_text;
+            if (has_text)
+                next_text = std::async(std::launch::async, [&]() { return reader.ReadLines(next, block_size); });
+            more = block(text.data(), text.data() + text.size()) && has_text;
+            more = more && next_text.get();
+            text.swap(next);
+        }
+    }
+    else
+    {
+        MappedFile csv;
+        if (!csv.Open(path))
+        {
+            throw std::runtime_error("Error in reading CSV file.\nThere is no such file: " + path);
+        }
+        const char * pos = csv.Data();
+        const char * text_end = csv.Data() + csv.Size();
+        bool more = true;
+        do
+        {
+            const char * block_end = pos + std::min<size_t>(block_size, text_end - pos);
+            if (block_end > pos)
+            {
+                const char * newline = static_cast<const char*>(memchr(block_end - 1, '\n', text_end - block_end + 1));
+                block_end = newline ? newline + 1 : text_end;
+            }
+            more = block(pos, block_end);
+            if (block_end < text_end)
+                csv.Release();
+            pos = block_end;
+        }
+        while (more && pos < text_end);
+    }
 }
 
-template<typename Scalar>
-void Seismogramm<Scalar>::swap_data_endian()
+// Reads the header line of CSV text: every receiver has dims columns after the time column.
+// Returns the beginning of the first data line.
+const char* read_csv_header(const char * text_begin, const char * text_end, int dims,
+                            IndexType& num_of_all_traces, IndexType& num_of_receivers)
 {
-    for (int i = 0; i < data.size(); i++)
-        for (int j = 0; j < data[i].size(); j++)
+    const char * header_end = static_cast<const char*>(memchr(text_begin, '\n', text_end - text_begin));
+    header_end = header_end ? header_end : text_end;
+    CsvLine header;
+    header.Split(text_begin, header_end);
+    num_of_all_traces = header.NumCells() - 1;
+    num_of_receivers = num_of_all_traces / dims;
+    if (header.NumCells() > 0 && header.CellEquals(header.NumCells() - 1, "\r")) num_of_all_traces -= 1;
+    return std::min(header_end + 1, text_end);
+}
+
+// Parses the CSV lines of [text_begin, text_end) in parallel: the text is split
+// into chunks of whole lines, the lines of every chunk are counted to know the
+// time slot of each row, then chunks are parsed straight into their slots.
+// data[k] gets num_of_receivers traces of component k and line_times the time of
+// every line. Parsing stops at the first line with less than num_of_all_traces + 1
+// cells; returns the number of lines before it, the traces are cut to that length.
+// found_short_line, if given, tells whether there was such a line.
+template <typename Scalar, int dims>
+size_t parse_csv_rows(const char * text_begin, const char * text_end, IndexType num_of_all_traces,
+                      IndexType num_of_receivers, int num_threads, TraceMatrix<Scalar> * const * data,
+                      std::vector<Scalar>& line_times, bool * found_short_line = NULL)
+{
+    size_t num_of_chunks = std::max<size_t>(1, (text_end - text_begin) / CSV_CHUNK_SIZE);
+    std::vector<const char*> chunk_bounds = split_line_chunks(text_begin, text_end, num_of_chunks);
+    std::vector<size_t> chunk_rows(num_of_chunks + 1, 0);
+    parallel_for(num_of_chunks, num_threads, [&](size_t chunk)
+    {
+        chunk_rows[chunk + 1] = count_lines(chunk_bounds[chunk], chunk_bounds[chunk + 1]);
+    });
+    for (size_t chunk = 0; chunk < num_of_chunks; chunk++)
+        chunk_rows[chunk + 1] += chunk_rows[chunk];
+    const size_t num_of_lines = chunk_rows.back();
+
+    line_times.resize(num_of_lines);
+    for (int k = 0; k < dims; k++)
+    {
+        data[k]->clear();
+        data[k]->resize(num_of_receivers, num_of_lines);
+    }
+    // Index of the first short line, chunks past it are skipped
+    std::atomic<size_t> first_short_line(num_of_lines);
+    parallel_for(num_of_chunks, num_threads, [&](size_t chunk)
+    {
+        // Rows are collected in time-major tiles which are transposed
+        // into the traces CSV_TIME_BLOCK time steps at a time
+        static thread_local std::vector<Scalar> tiles[dims];
+        for (int k = 0; k < dims; k++)
+            tiles[k].resize(size_t(CSV_TIME_BLOCK) * num_of_receivers);
+        StatsTimer timer(STATS_LOAD, chunk_bounds[chunk + 1] - chunk_bounds[chunk]);
+        CsvLine line;
+        size_t row = chunk_rows[chunk];
+        size_t block_begin = row;
+        const char * pos = chunk_bounds[chunk];
+        const char * end = chunk_bounds[chunk + 1];
+        bool reading = true;
+        while (reading)
         {
-            swap_endian(data[i][j]);
+            reading = pos < end && row < first_short_line.load(std::memory_order_relaxed);
+            if (reading)
+            {
+                const char * newline = static_cast<const char*>(memchr(pos, '\n', end - pos));
+                const char * line_end = newline ? newline : end;
+                line.Split(pos, line_end);
+                pos = newline ? newline + 1 : end;
+                if (line.NumCells() < num_of_all_traces + 1)
+                {
+                    size_t known = first_short_line.load();
+                    while (row < known && !first_short_line.compare_exchange_weak(known, row))
+                    {
+                    }
+                    reading = false;
+                }
+            }
+            if (reading)
+            {
+                size_t row_offset = (row - block_begin) * num_of_receivers;
+                line_times[row] = line.CellAsDouble(0);
+                for (IndexType trace_i = 0; trace_i < num_of_receivers; trace_i++)
+                {
+                    for (int k = 0; k < dims; k++)
+                        tiles[k][row_offset + trace_i] = line.CellAsDouble(1 + k + trace_i * dims);
+                }
+                row++;
+                timer.Add(0, uint64(num_of_receivers) * dims);
+            }
+            if (row - block_begin == CSV_TIME_BLOCK || (!reading && row > block_begin))
+            {
+                for (int k = 0; k < dims; k++)
+                {
+                    transpose(tiles[k].data(), num_of_receivers, data[k]->data() + block_begin, data[k]->stride(),
+                              row - block_begin, num_of_receivers);
+                }
+                block_begin = row;
+            }
         }
+    });
+    const size_t num_of_rows = first_short_line.load();
+    for (int k = 0; k < dims; k++)
+        data[k]->resize(num_of_receivers, num_of_rows);
+    line_times.resize(num_of_rows);
+    if (found_short_line)
+        *found_short_line = num_of_rows < num_of_lines;
+    return num_of_rows;
 }
 
+// Reads receiver positions from <path>.receivers.csv and the source position
+// from <path>.source.csv, missing files give zero positions
+template <typename Scalar>
+void read_csv_positions(const std::string& path, IndexType num_of_receivers, std::vector<Scalar>& rec_x,
+                        std::vector<Scalar>& rec_y, Scalar& source_x, Scalar& source_y)
+{
+    // Reading receivers data
+    std::string filename_rec = path + ".receivers.csv";
+    CsvReader ifs_rec(';', 64 * 1024);
+    rec_x.clear();
+    rec_y.clear();
+    if (ifs_rec.Open(filename_rec))
+    {
+        for (IndexType i = 0; i < num_of_receivers; i++)
+        {
+            ifs_rec.ReadLine();
+            if (ifs_rec.NumCells() < 2)
+            {
+                std::cout << "Error while reading receivers data" << std::endl;
+            }
+            else
+            {
+                rec_x.push_back(ifs_rec.CellAsDouble(0));
+                rec_y.push_back(ifs_rec.CellAsDouble(1));
+            }
+        }
+    }
+    else
+    {
+        std::cout << "Warning: no csv receivers data found" << std::endl;
+        std::cout << "         All receivers positions have been set to (0.0, 0.0)" << std::endl;
+    }
+    rec_x.resize(num_of_receivers, 0.0);
+    rec_y.resize(num_of_receivers, 0.0);
+
+    // Reading source data
+    std::string filename_source = path + ".source.csv";
+    CsvReader ifs_source(';', 64 * 1024);
+    source_x = 0.0;
+    source_y = 0.0;
+    if (ifs_source.Open(filename_source))
+    {
+        ifs_source.ReadLine();
+        if (ifs_source.NumCells() < 2)
+        {
+            std::cout << "Error while reading source data" << std::endl;
+        }
+        else
+        {
+            source_x = ifs_source.CellAsDouble(0);
+            source_y = ifs_source.CellAsDouble(1);
+        }
+    }
+    else
+    {
+        std::cout << "Warning: no csv source data found" << std::endl;
+        std::cout << "         Source position has been set to (0.0, 0.0)" << std::endl;
+    }
+}
 
-template<typename Scalar>
-void Seismogramm<Scalar>::LoadSegY(const std::string& path, std::vector<Scalar>& times)
+// Names of component arrays: <path>_x.npy, <path>_y.npy, <path>_z.npy
+const char * npy_component_suffixes[3] = { "_x.npy", "_y.npy", "_z.npy" };
+
+// Element type of Scalar arrays
+template <typename Scalar>
+const char* npy_scalar_descr()
 {
-    std::ifstream inf;
-    inf.open(path.data(), std::ios::binary);
-    if (!inf)
+    return (sizeof(Scalar) == 8) ? NPY_NATIVE_FLOAT64 : NPY_NATIVE_FLOAT32;
+}
+
+// Loads a (receivers, num_of_times) array of floats into data, returns the number of receivers
+template <typename Scalar>
+IndexType load_npy_traces(const std::string& path, size_t num_of_times, TraceMatrix<Scalar>& data)
+{
+    NpyFile file;
+    if (!file.Open(path))
     {
-        std::cout << "Error in reading SEG-Y file." << std::endl;
-        std::cout << "There is no such file: " << path << std::endl;
-        std::exit(1);
+        throw std::runtime_error("Error in reading NPY file.\nThere is no such file: " + path);
     }
-    // Loading Text Header
-    char text_header[3200];
-    inf.read(text_header, 3200);
+    const std::string native = npy_scalar_descr<Scalar>();
+    const bool swapped = file.Descr().substr(1) == native.substr(1) && file.Descr()[0] != native[0];
+    if ((file.Descr() != native && !swapped) || sizeof(Scalar) != 4)
+    {
+        throw std::runtime_error("Error in reading NPY file " + path + ": unsupported element type '" + file.Descr() + "'");
+    }
+    if (file.Shape().size() != 2 || file.Shape()[1] != num_of_times)
+    {
+        throw std::runtime_error("Error in reading NPY file " + path + ": the shape should be (receivers, times)");
+    }
+    // Rows are copied straight from the mapping, byte order is fixed while copying
+    const IndexType num_of_receivers = file.Shape()[0];
+    StatsTimer timer(STATS_LOAD, sizeof(Scalar) * num_of_times * num_of_receivers, num_of_times * num_of_receivers);
+    data.clear();
+    data.resize(num_of_receivers, num_of_times);
+    for (IndexType i = 0; i < num_of_receivers; i++)
+    {
+        const char * row = file.Data() + sizeof(Scalar) * num_of_times * i;
+        if (swapped)
+            swap_bytes_32(row, data[i].data(), num_of_times);
+        else
+            memcpy(data[i].data(), row, sizeof(Scalar) * num_of_times);
+    }
+    return num_of_receivers;
+}
 
-    // Loading Binary Header
-    inf.read(reinterpret_cast<char*>(&header_data), sizeof(header_data));
-    swap_header_endian();
+// Reads receiver positions from <path>.rec.npy, a (receivers, 2) array, and the
+// source position from <path>.source.npy, an array of 2 values; missing files give zero positions
+template <typename Scalar>
+void read_npy_positions(const std::string& path, IndexType num_of_receivers, std::vector<Scalar>& rec_x,
+                        std::vector<Scalar>& rec_y, Scalar& source_x, Scalar& source_y)
+{
+    NpyFile file;
+    rec_x.assign(num_of_receivers, 0.0);
+    rec_y.assign(num_of_receivers, 0.0);
+    if (file.Open(path + ".rec.npy"))
+    {
+        std::vector<double> values = file.ValuesAsDouble();
+        if (file.Shape().size() != 2 || file.Shape()[0] != num_of_receivers || file.Shape()[1] != 2)
+        {
+            std::cout << "Error while reading receivers data" << std::endl;
+        }
+        else
+        {
+            for (IndexType i = 0; i < num_of_receivers; i++)
+            {
+                rec_x[i] = values[2 * i];
+                rec_y[i] = values[2 * i + 1];
+            }
+        }
+    }
+    else
+    {
+        std::cout << "Warning: no npy receivers data found" << std::endl;
+        std::cout << "         All receivers positions have been set to (0.0, 0.0)" << std::endl;
+    }
 
-    // Loading Data and Trace Headers
-    data.resize(header_data.num_of_traces_per_record);
-    trace_header_data.resize(header_data.num_of_traces_per_record);
-    for (int i = 0; i < header_data.num_of_traces_per_record; i++)
+    source_x = 0.0;
+    source_y = 0.0;
+    if (file.Open(path + ".source.npy"))
     {
-        data[i].resize(header_data.samples_per_trace);
+        std::vector<double> values = file.ValuesAsDouble();
+        if (values.size() < 2)
+        {
+            std::cout << "Error while reading source data" << std::endl;
+        }
+        else
+        {
+            source_x = values[0];
+            source_y = values[1];
+        }
     }
-    for (int i = 0; i < header_data.num_of_traces_per_record; i++)
+    else
     {
-        inf.read(reinterpret_cast<char*>(&trace_header_data[i]), sizeof(trace_header_data[i]));
-        inf.read(reinterpret_cast<char*>(data[i].data()), sizeof(float) * header_data.samples_per_trace);
+        std::cout << "Warning: no npy source data found" << std::endl;
+        std::cout << "         Source position has been set to (0.0, 0.0)" << std::endl;
     }
-    swap_all_trace_headers_endian();
-    swap_data_endian();
+}
 
-    // Setting Times
-    times.resize(header_data.samples_per_trace);
-    for (int i = 0; i < header_data.samples_per_trace; i++)
+// Times of the samples of a SEG-Y file with the given binary header, starting from first_sample
+template <typename Scalar>
+void set_segy_times(const segy_bin_header_data& header, std::vector<Scalar>& times, IndexType first_sample = 0)
+{
+    const double interval = segy_sample_interval(header);
+    times.resize(segy_samples_per_trace(header));
+    for (size_t i = 0; i < times.size(); i++)
     {
-        times[i] = header_data.sample_interval * 0.000001 * i;
+        times[i] = interval * 0.000001 * (first_sample + i);
     }
 }
 
-template<typename Scalar>
-void Seismogramm<Scalar>::SaveSegY(const std::string& path, const std::vector<Scalar>& times, bool save_empty_headers)
+// Samples [first_sample, first_sample + num_of_samples) of a trace of the file that are inside the time window
+void segy_window_samples(const segy_bin_header_data& header, const SegYWindow& window,
+                         IndexType& first_sample, IndexType& num_of_samples)
 {
-    std::ofstream outf (path.data(), std::ios::out | std::ios::binary);
-    if (!outf)
+    const double interval = segy_sample_interval(header) * 0.000001;
+    const IndexType num_of_all_samples = segy_samples_per_trace(header);
+    first_sample = 0;
+    num_of_samples = num_of_all_samples;
+    if (interval <= 0.0)
+        return;
+    // Times that are equal to a sample time up to rounding select it
+    if (window.start_time > 0.0)
+        first_sample = std::min<double>(num_of_all_samples, ceil(window.start_time / interval - 1e-6));
+    double end = num_of_all_samples;
+    if (window.end_time >= 0.0)
+        end = std::min<double>(end, floor(window.end_time / interval + 1e-6) + 1.0);
+    num_of_samples = (end > first_sample) ? IndexType(end) - first_sample : 0;
+}
+
+// Largest piece of a SEG-Y file read at once by direct reads
+#define SEGY_DIRECT_READ_SIZE (4 * 1024 * 1024)
+// Bytes between needed parts of traces that are read along rather than skipped
+#define SEGY_READ_GAP (64 * 1024)
+
+// Reads the headers and samples [first_sample, first_sample + num_of_samples) of the traces at the
+// given offsets of a SEG-Y file, skipping the rest of the file. Needed parts closer than
+// SEGY_READ_GAP to each other are read with one pread; decode(i, header, samples) is called
+// with the raw data of the trace at offsets[i].
+void read_segy_traces(const ReadAheadFile& file, const std::vector<uint64_t>& offsets,
+                      IndexType first_sample, IndexType num_of_samples,
+                      const std::function<void(size_t, const char*, const char*)>& decode)
+{
+    const size_t samples_begin = sizeof(segy_trace_header) + sizeof(float) * size_t(first_sample);
+    const size_t samples_size = sizeof(float) * size_t(num_of_samples);
+    const bool whole_traces = samples_begin - sizeof(segy_trace_header) <= SEGY_READ_GAP;
+    std::vector<char> buffer;
+    for (size_t first = 0, last; first < offsets.size(); first = last)
     {
-        std::cout << "Error in writing SEG-Y file.\n";
-        std::exit(1);
+        const uint64_t begin = offsets[first];
+        last = first + 1;
+        if (whole_traces)
+        {
+            uint64_t end = begin + samples_begin + samples_size;
+            for (; last < offsets.size(); last++)
+            {
+                const uint64_t next_end = offsets[last] + samples_begin + samples_size;
+                if (offsets[last] < end || offsets[last] - end > SEGY_READ_GAP || next_end - begin > SEGY_DIRECT_READ_SIZE)
+                    break;
+                end = next_end;
+            }
+            buffer.resize(end - begin);
+            file.ReadAt(begin, buffer.data(), buffer.size());
+            for (size_t i = first; i < last; i++)
+            {
+                const char * raw = buffer.data() + (offsets[i] - begin);
+                decode(i, raw, raw + samples_begin);
+            }
+        }
+        else
+        {
+            // Samples far from the header are read separately
+            buffer.resize(sizeof(segy_trace_header) + samples_size);
+            file.ReadAt(begin, buffer.data(), sizeof(segy_trace_header));
+            file.ReadAt(begin + samples_begin, buffer.data() + sizeof(segy_trace_header), samples_size);
+            decode(first, buffer.data(), buffer.data() + sizeof(segy_trace_header));
+        }
+    }
+}
+
+// Reads the binary header of a SEG-Y file opened for direct reads, throws if it isn't a
+// SEG-Y file with supported samples. Returns the number of whole traces in the file.
+IndexType read_segy_bin_header(const ReadAheadFile& file, const std::string& path, segy_bin_header_data& header)
+{
+    if (file.Size() < SEGY_DATA_OFFSET)
+        throw std::runtime_error("Error in reading SEG-Y file.\nThere is no such file: " + path);
+    file.ReadAt(SEGY_TEXT_HEADER_SIZE, &header, sizeof(header));
+    swap_segy_bin_header(header);
+    check_segy_data_offset(header, file.Size());
+    check_sample_format(header.data_sample_format, path);
+    const IndexType num_of_traces = segy_num_traces(header, file.Size());
+    if (num_of_traces < segy_declared_num_traces(header))
+        warn_truncated_segy_file(path, num_of_traces);
+    return num_of_traces;
+}
+
+// Reads num_of_traces records of trace_size bytes from data_offset on with the read-ahead
+// pipeline; decode(i, record) is called with the raw record of every trace in turn
+void read_segy_records(ReadAheadFile& file, uint64 data_offset, IndexType num_of_traces, size_t trace_size,
+                       const std::function<void(IndexType, const char*)>& decode)
+{
+    // Traces are decoded from the blocks as they arrive, a trace that
+    // crosses the end of a block is assembled in a separate buffer
+    std::vector<char> record(trace_size);
+    size_t record_filled = 0;
+    IndexType trace_i = 0;
+    file.Start(data_offset, data_offset + uint64(num_of_traces) * trace_size);
+    const char * block;
+    size_t block_size;
+    while (file.Next(block, block_size))
+    {
+        const char * end = block + block_size;
+        if (record_filled > 0)
+        {
+            size_t count = std::min<size_t>(trace_size - record_filled, end - block);
+            memcpy(&record[record_filled], block, count);
+            record_filled += count;
+            block += count;
+            if (record_filled < trace_size)
+                continue;
+            decode(trace_i++, record.data());
+            record_filled = 0;
+        }
+        for (; size_t(end - block) >= trace_size; block += trace_size)
+            decode(trace_i++, block);
+        memcpy(record.data(), block, end - block);
+        record_filled = end - block;
     }
+}
 
+// Writes the text header, zero filled, and the binary header (zero filled too if empty) of a SEG-Y file
+void write_segy_file_header(std::ofstream& outf, const segy_bin_header_data& header_data, bool empty)
+{
     char text_header[3200];
     for (int i = 0; i < 3200; i++)
         text_header[i] = 0;
@@ -160,37 +621,256 @@ void Seismogramm<Scalar>::SaveSegY(const std::string& path, const std::vector<Sc
     for (int i = 0; i < sizeof(segy_bin_header_data); i++)
         empty_bin_header[i] = 0;
 
-    char empty_trace_header[sizeof(segy_trace_header)];
-    for (int i = 0; i < sizeof(segy_trace_header); i++)
-        empty_trace_header[i] = 0;
-
     outf.write(text_header, 3200);
 
+    // Saving Binary Header
+    segy_bin_header_data big_endian_header = header_data;
+    swap_segy_bin_header(big_endian_header);
+    if (empty)
+        outf.write(reinterpret_cast<char*>(&empty_bin_header), sizeof(empty_bin_header));
+    else
+        outf.write(reinterpret_cast<char*>(&big_endian_header), sizeof(big_endian_header));
+}
+
+// Writes the first num_of_traces traces of data as SEG-Y records, trace i with the header
+// trace_headers[i] (zero headers if trace_headers is NULL). Traces are converted to big endian
+// in a staging buffer which is written as soon as it is full, data itself is never modified.
+template <typename Scalar>
+void write_segy_records(std::ofstream& outf, const TraceMatrix<Scalar>& data, const segy_trace_header * trace_headers,
+                        size_t num_of_traces, int sample_format)
+{
+    const size_t record_size = sizeof(segy_trace_header) + sizeof(float) * data.cols();
+    const size_t records_per_chunk = std::max<size_t>(1, SEGY_STAGING_SIZE / record_size);
+    static thread_local std::vector<char> staging;
+    staging.resize(records_per_chunk * record_size);
+    for (size_t first = 0; first < num_of_traces; first += records_per_chunk)
+    {
+        size_t last = std::min(num_of_traces, first + records_per_chunk);
+        char * record = staging.data();
+        for (size_t i = first; i < last; i++)
+        {
+            segy_trace_header big_endian_trace_header;
+            if (!trace_headers)
+                memset(&big_endian_trace_header, 0, sizeof(big_endian_trace_header));
+            else
+            {
+                big_endian_trace_header = trace_headers[i];
+                swap_segy_trace_header(big_endian_trace_header);
+            }
+            memcpy(record, &big_endian_trace_header, sizeof(big_endian_trace_header));
+            encode_samples(data[i].data(), record + sizeof(segy_trace_header), data.cols(), sample_format);
+            record += record_size;
+        }
+        StatsTimer timer(STATS_WRITE, record - staging.data(), 0);
+        outf.write(staging.data(), record - staging.data());
+    }
+}
+
+// Writes trace of the runs as a SEG-Y record with the given header, resampling it tile_size
+// output samples at a time, so that only a tile of the trace is in memory
+template <typename Scalar>
+void write_segy_record_in_tiles(std::ofstream& outf, TraceRunFile& runs, IndexType trace, const segy_trace_header& header,
+                                const Resampler<Scalar>& resampler, size_t tile_size, int sample_format)
+{
+    static thread_local std::vector<Scalar> input, output;
+    static thread_local std::vector<char> staging;
+    segy_trace_header big_endian_trace_header = header;
+    swap_segy_trace_header(big_endian_trace_header);
+    outf.write(reinterpret_cast<const char*>(&big_endian_trace_header), sizeof(big_endian_trace_header));
+    for (size_t begin = 0; begin < resampler.OutputSize(); begin += tile_size)
+    {
+        const size_t end = std::min(resampler.OutputSize(), begin + tile_size);
+        const size_t first_input = resampler.FirstInput(begin);
+        const size_t num_of_inputs = resampler.LastInput(end - 1) - first_input + 1;
+        input.resize(num_of_inputs);
+        output.resize(end - begin);
+        staging.resize(sizeof(float) * (end - begin));
+        runs.ReadSamples(trace, first_input, num_of_inputs, input.data());
+        {
+            StatsTimer timer(STATS_RESAMPLE, sizeof(Scalar) * (end - begin), end - begin);
+            resampler.Apply(input.data(), first_input, output.data(), begin, end);
+        }
+        encode_samples(output.data(), staging.data(), end - begin, sample_format);
+        StatsTimer timer(STATS_WRITE, staging.size(), 0);
+        outf.write(staging.data(), staging.size());
+    }
+}
 
+// |||||||||||||||||||||||||||||||||||||||||||||||||||||||||||||||||||||||| \\
+// |||||||||||||||||||||||| Seismogramm ||||||||||||||||||||||||||||||||||| \\
+// |||||||||||||||||||||||||||||||||||||||||||||||||||||||||||||||||||||||| \\
 
 
-    // Saving Binary Header
-    swap_header_endian();
-    if (save_empty_headers)
-        outf.write(reinterpret_cast<char*>(&empty_bin_header), sizeof(empty_bin_header));
+
+template<typename Scalar>
+void Seismogramm<Scalar>::LoadSegY(const std::string& path, std::vector<Scalar>& times, const SegYReadOptions& options,
+                                   const SegYWindow& window)
+{
+    StatsTimer timer(STATS_LOAD);
+    if (!window.IsWhole())
+    {
+        load_segy_window(path, window, times);
+        timer.Add(uint64(data.size()) * segy_trace_size(header_data), uint64(data.size()) * data.cols());
+        return;
+    }
+    if (options.read_ahead > 0)
+    {
+        load_segy_read_ahead(path, options);
+    }
     else
-        outf.write(reinterpret_cast<char*>(&header_data), sizeof(header_data));
-    swap_header_endian();
+    {
+        SegYFileView file;
+        open_segy_file(file, path);
+        if (!file.IsComplete())
+            warn_truncated_segy_file(path, file.NumTraces());
+        header_data = file.BinaryHeader();
+        set_segy_num_traces(header_data, file.NumTraces());
+
+        // Loading Data and Trace Headers straight from the mapping,
+        // byte order is fixed while copying
+        data.clear();
+        data.resize(file.NumTraces(), file.NumSamples());
+        trace_lengths.clear();
+        trace_header_data.resize(file.NumTraces());
+        for (IndexType i = 0; i < file.NumTraces(); i++)
+        {
+            trace_header_data[i] = file.TraceHeader(i);
+            file.Trace(i).CopyTo(data[i].data());
+        }
+    }
+    timer.Add(uint64(data.size()) * segy_trace_size(header_data), uint64(data.size()) * data.cols());
 
-    // Saving Data and Trace Headers
-    swap_all_trace_headers_endian();
-    swap_data_endian();
-    for (uint32 i = 0; i <  header_data.num_of_traces_per_record; i++)
+    set_segy_times(header_data, times);
+}
+
+template<typename Scalar>
+void Seismogramm<Scalar>::LoadSegYTraces(const std::string& path, const SegYIndex& index, const std::vector<IndexType>& traces,
+                                         std::vector<Scalar>& times)
+{
+    ReadAheadFile file(READ_AHEAD_ALIGNMENT, 1, 1);
+    if (!file.Open(path))
+        throw std::runtime_error("Error in reading SEG-Y file.\nThere is no such file: " + path);
+    header_data = index.BinaryHeader();
+    check_sample_format(header_data.data_sample_format, path);
+    set_segy_num_traces(header_data, traces.size());
+
+    const IndexType num_of_samples = segy_samples_per_trace(header_data);
+    StatsTimer timer(STATS_LOAD, uint64(traces.size()) * segy_trace_size(header_data), uint64(traces.size()) * num_of_samples);
+    const std::vector<segy_index_entry>& entries = index.Entries();
+    data.clear();
+    data.resize(traces.size(), num_of_samples);
+    trace_lengths.clear();
+    trace_header_data.resize(traces.size());
+
+    std::vector<uint64_t> offsets(traces.size());
+    for (size_t i = 0; i < traces.size(); i++)
     {
-        if (save_empty_headers)
-            outf.write(reinterpret_cast<char*>(&empty_trace_header), sizeof(empty_trace_header));
-        else
-            outf.write(reinterpret_cast<char*>(&trace_header_data.at(i)), sizeof(trace_header_data.at(i)));
+        if (traces[i] >= entries.size())
+        {
+            std::ostringstream message;
+            message << "Error in reading SEG-Y file " << path << "\nThere is no trace " << traces[i]
+                    << " in the index, it has " << entries.size() << " traces";
+            throw std::runtime_error(message.str());
+        }
+        offsets[i] = entries[traces[i]].offset;
+    }
+    read_segy_traces(file, offsets, 0, num_of_samples, [&](size_t i, const char * header, const char * samples)
+    {
+        memcpy(&trace_header_data[i], header, sizeof(segy_trace_header));
+        swap_segy_trace_header(trace_header_data[i]);
+        decode_samples(samples, data[i].data(), num_of_samples, header_data.data_sample_format);
+    });
+
+    set_segy_times(header_data, times);
+}
 
-        outf.write(reinterpret_cast<char*>(data.at(i).data()), sizeof(float) * data.at(i).size());
+template<typename Scalar>
+void Seismogramm<Scalar>::load_segy_window(const std::string& path, const SegYWindow& window, std::vector<Scalar>& times)
+{
+    ReadAheadFile file(READ_AHEAD_ALIGNMENT, 1, 1);
+    if (!file.Open(path))
+        throw std::runtime_error("Error in reading SEG-Y file.\nThere is no such file: " + path);
+    const IndexType num_of_all_traces = read_segy_bin_header(file, path, header_data);
+
+    IndexType first_sample, num_of_samples;
+    segy_window_samples(header_data, window, first_sample, num_of_samples);
+    if (window.first_trace >= num_of_all_traces || num_of_samples == 0)
+    {
+        std::ostringstream message;
+        message << "Error in reading SEG-Y file " << path << "\nThe window (traces from " << window.first_trace
+                << ", times from " << window.start_time << " s) is outside of the file, it has "
+                << num_of_all_traces << " traces of " << segy_samples_per_trace(header_data) << " samples";
+        throw std::runtime_error(message.str());
     }
-    swap_all_trace_headers_endian();
-    swap_data_endian();
+    IndexType num_of_traces = num_of_all_traces - window.first_trace;
+    if (window.num_traces > 0)
+        num_of_traces = std::min(num_of_traces, window.num_traces);
+    set_segy_num_traces(header_data, num_of_traces);
+
+    const size_t trace_size = segy_trace_size(header_data);
+    const uint64 data_offset = segy_data_offset(header_data);
+    std::vector<uint64_t> offsets(num_of_traces);
+    for (IndexType i = 0; i < num_of_traces; i++)
+        offsets[i] = data_offset + uint64(window.first_trace + i) * trace_size;
+    set_segy_samples_per_trace(header_data, num_of_samples);
+    data.clear();
+    data.resize(num_of_traces, num_of_samples);
+    trace_lengths.clear();
+    trace_header_data.resize(num_of_traces);
+    read_segy_traces(file, offsets, first_sample, num_of_samples, [&](size_t i, const char * header, const char * samples)
+    {
+        memcpy(&trace_header_data[i], header, sizeof(segy_trace_header));
+        swap_segy_trace_header(trace_header_data[i]);
+        trace_header_data[i].num_of_samples = segy_trace_num_of_samples(num_of_samples);
+        decode_samples(samples, data[i].data(), num_of_samples, header_data.data_sample_format);
+    });
+
+    set_segy_times(header_data, times, first_sample);
+}
+
+template<typename Scalar>
+void Seismogramm<Scalar>::load_segy_read_ahead(const std::string& path, const SegYReadOptions& options)
+{
+    ReadAheadFile file(options.block_size, options.read_ahead, options.io_threads);
+    if (!file.Open(path))
+        throw std::runtime_error("Error in reading SEG-Y file.\nThere is no such file: " + path);
+    const IndexType num_of_traces = read_segy_bin_header(file, path, header_data);
+
+    const IndexType num_of_samples = segy_samples_per_trace(header_data);
+    const size_t trace_size = segy_trace_size(header_data);
+    data.clear();
+    data.resize(num_of_traces, num_of_samples);
+    trace_lengths.clear();
+    trace_header_data.resize(num_of_traces);
+
+    const uint64 data_offset = segy_data_offset(header_data);
+    set_segy_num_traces(header_data, num_of_traces);
+    read_segy_records(file, data_offset, num_of_traces, trace_size, [&](IndexType i, const char * raw)
+    {
+        memcpy(&trace_header_data[i], raw, sizeof(segy_trace_header));
+        swap_segy_trace_header(trace_header_data[i]);
+        decode_samples(raw + sizeof(segy_trace_header), data[i].data(), num_of_samples, header_data.data_sample_format);
+    });
+}
+
+template<typename Scalar>
+void Seismogramm<Scalar>::SaveSegY(const std::string& path, const std::vector<Scalar>& times, bool save_empty_headers) const
+{
+    std::ofstream outf (path.data(), std::ios::out | std::ios::binary);
+    if (!outf)
+    {
+        throw std::runtime_error("Error in writing SEG-Y file: " + path);
+    }
+    write_segy_file_header(outf, header_data, save_empty_headers);
+
+    // Saving Data and Trace Headers
+    const size_t num_of_traces = segy_declared_num_traces(header_data);
+    if (num_of_traces > data.size() || (!save_empty_headers && num_of_traces > trace_header_data.size()))
+    {
+        throw std::runtime_error("Error in writing SEG-Y file: there are less traces than the header says: " + path);
+    }
+    write_segy_records(outf, data, save_empty_headers ? NULL : trace_header_data.data(), num_of_traces,
+                       header_data.data_sample_format);
 
     outf.close();
 
@@ -200,12 +880,11 @@ void Seismogramm<Scalar>::SaveSegY(const std::string& path, const std::vector<Sc
         std::ofstream additionalf ((path + ".info.txt").data(), std::ios::out);
         if (!additionalf)
         {
-            std::cout << "Error in writing SEG-Y file(additional info).\n";
-            std::exit(1);
+            throw std::runtime_error("Error in writing SEG-Y file(additional info): " + path + ".info.txt");
         }
-        additionalf << "Number of traces = " <<  header_data.num_of_traces_per_record << std::endl;
-        additionalf << "Number of samples = " <<  header_data.samples_per_trace << std::endl;
-        additionalf << "Time step(in ms.) = " <<  header_data.sample_interval << std::endl;
+        additionalf << "Number of traces = " <<  num_of_traces << std::endl;
+        additionalf << "Number of samples = " <<  segy_samples_per_trace(header_data) << std::endl;
+        additionalf << "Time step(in ms.) = " <<  segy_sample_interval(header_data) << std::endl;
         additionalf.close();
     }
 }
@@ -213,7 +892,19 @@ void Seismogramm<Scalar>::SaveSegY(const std::string& path, const std::vector<Sc
 template<typename Scalar>
 void Seismogramm<Scalar>::AddValue(const Sample& value, IndexType detectorIndex)
 {
-    data[detectorIndex].push_back(value);
+    // Traces are recorded one sample at a time, the matrix gets a new
+    // column when the first trace runs past its end
+    if (detectorIndex >= data.size())
+        data.resize(detectorIndex + 1);
+    if (trace_lengths.empty())
+        trace_lengths.assign(data.size(), data.cols());
+    trace_lengths.resize(data.size(), 0);
+    IndexType& length = trace_lengths[detectorIndex];
+    if (length > data.cols())
+        length = data.cols();
+    if (length == data.cols())
+        data.resize(data.size(), length + 1);
+    data[detectorIndex][length++] = value;
 }
 
 // |||||||||||||||||||||||||||||||||||||||||||||||||||||||||||||||||||||||| \\
@@ -224,202 +915,179 @@ void Seismogramm<Scalar>::AddValue(const Sample& value, IndexType detectorIndex)
 template <typename Scalar, int dims>
 void CombinedSeismogramm<Scalar, dims>::Load(SeismoType type, std::vector<std::string> paths)
 {
+    staged_steps = 0;
     seismogramms.resize(componentInfos.size());
     if (type == SEG_Y)
     {
-        for (IndexType p = 0; p < paths.size(); ++p)
+        // Component files are independent, each one is read by its own thread
+        if (paths.size() > seismogramms.size())
+            seismogramms.resize(paths.size());
+        std::vector<std::vector<Scalar> > component_times(paths.size());
+        parallel_for(paths.size(), num_threads, [&](size_t p)
+        {
+            if (segy_query.IsEmpty())
+            {
+                seismogramms[p].LoadSegY(paths[p], component_times[p], segy_read_options, segy_window);
+                return;
+            }
+            // The index is built, or rebuilt if stale, on the first query
+            SegYIndex index;
+            index.Open(paths[p]);
+            seismogramms[p].LoadSegYTraces(paths[p], index, index.Find(segy_query), component_times[p]);
+        });
+        for (size_t p = 0; p < paths.size() && !segy_query.IsEmpty(); p++)
         {
-            seismogramms[p].LoadSegY(paths[p], times);
+            if (seismogramms[p].data.size() != seismogramms[0].data.size())
+                throw std::runtime_error("Error: the query selects different traces in SEG-Y components: " + paths[p]);
+            if (seismogramms[p].data.size() == 0)
+                throw std::runtime_error("Error: no traces of SEG-Y file " + paths[p] + " match the query");
         }
+        if (!paths.empty())
+            times.swap(component_times.back());
     }
     else if (type == CSV)
     {
         seismogramms.resize(paths.size() * dims);
         for (IndexType path_index = 0; path_index < paths.size(); path_index++)
         {
-            // Calculating number of time steps and number of traces
+            // Reading header, it defines the number of traces, and data; the time
+            // axis ends at the first line that is too short. A plain file is parsed
+            // at once, a .csv.gz one block by block with the rows appended to the traces
             // ///////////////////////////////////////
-            std::string filename = paths[path_index] + ".csv";
-            IndexType num_of_times = -1;
+            const std::string filename = find_csv_file(paths[path_index]);
             IndexType num_of_all_traces = 0;
-            IndexType num_of_receivers;
-            std::ifstream ifs0;
-            ifs0.open(filename.c_str());
-            if (!ifs0)
-            {
-                std::cout << "Error in reading CSV file." << std::endl;
-                std::cout << "There is no such file: " << filename << std::endl;
-                std::exit(1);
-            }
-            std::vector<std::string> line = getNextLineAndSplitIntoTokens(ifs0);
-            num_of_all_traces = line.size() - 1;
-            num_of_receivers = num_of_all_traces / dims;
-            if (line.back() == "\r") num_of_all_traces -= 1;
-            while (line.size() >= num_of_all_traces + 1)
-            {
-                line = getNextLineAndSplitIntoTokens(ifs0);
-                num_of_times++;
-            }
-            ifs0.close();
-
-            // Reading  data
-            // ///////////////////////////////////////
-            std::ifstream ifs;
-            ifs.open(filename.c_str());
-            getNextLineAndSplitIntoTokens(ifs);
-
-            line = getNextLineAndSplitIntoTokens(ifs);
-
+            IndexType num_of_receivers = 0;
+            TraceMatrix<Scalar> * component_data[dims];
+            TraceMatrix<Scalar> block_data[dims];
+            TraceMatrix<Scalar> * block_pointers[dims];
             for (int k = 0; k < dims; k++)
-                seismogramms.at(dims * path_index + k).data.resize((line.size()-1)/dims);
-
-            for (int trace_i = 0; trace_i < num_of_receivers; trace_i++)
             {
-                for (int k = 0; k < dims; k++)
-                    seismogramms.at(dims * path_index + k).data[trace_i].resize(num_of_times);
+                component_data[k] = &seismogramms.at(dims * path_index + k).data;
+                block_pointers[k] = &block_data[k];
             }
-            times.resize(num_of_times);
-
-            IndexType time_i = 0;
-            while (line.size() >= num_of_all_traces + 1)
+            std::vector<Scalar> line_times, block_times;
+            size_t num_of_rows = 0;
+            bool header_read = false;
+            for_each_csv_block(filename, is_gzip_path(filename) ? CSV_GZIP_BLOCK_SIZE : SIZE_MAX,
+                               [&](const char * text_begin, const char * text_end)
             {
-                times[time_i] = ::atof(line[0].c_str());
-                for (int trace_i = 0; trace_i < num_of_receivers; trace_i++)
+                bool found_short_line = false;
+                if (!header_read)
                 {
-                    seismogramms.at(dims * path_index + 0).data[trace_i][time_i] = ::atof(line[1 + trace_i * dims].c_str());
-                    seismogramms.at(dims * path_index + 1).data[trace_i][time_i] = ::atof(line[2 + trace_i * dims].c_str());
-                    if (dims >= 3)
-                        seismogramms.at(dims * path_index + 2).data[trace_i][time_i] = ::atof(line[3 + trace_i * dims].c_str());
+                    header_read = true;
+                    text_begin = read_csv_header(text_begin, text_end, dims, num_of_all_traces, num_of_receivers);
+                    num_of_rows = parse_csv_rows<Scalar, dims>(text_begin, text_end, num_of_all_traces, num_of_receivers,
+                                                               num_threads, component_data, line_times, &found_short_line);
+                    return !found_short_line;
                 }
-                line = getNextLineAndSplitIntoTokens(ifs);
-                time_i++;
-            }
+                const size_t block_rows = parse_csv_rows<Scalar, dims>(text_begin, text_end, num_of_all_traces, num_of_receivers,
+                                                                       num_threads, block_pointers, block_times, &found_short_line);
+                for (int k = 0; k < dims; k++)
+                {
+                    component_data[k]->extend_cols(num_of_rows + block_rows);
+                    for (IndexType i = 0; i < num_of_receivers; i++)
+                        memcpy((*component_data[k])[i].data() + num_of_rows, block_data[k][i].data(), sizeof(Scalar) * block_rows);
+                }
+                line_times.insert(line_times.end(), block_times.begin(), block_times.end());
+                num_of_rows += block_rows;
+                return !found_short_line;
+            });
+            times.assign(line_times.begin(), line_times.begin() + num_of_rows);
+            IndexType num_of_times = times.size();
 
             // Interpolating results on eqidistant time grid
             // ///////////////////////////////////////
 
             Scalar interval = (times[num_of_times-1] - times[0]) / (num_of_times - 1);
             interpolate_data_on_equal_time_intervals(interval * interpolation_multiplier);
-            num_of_times = times.size();
-            interval = times[1] - times[0];
-
 
-            // Set binary header data
+            // Set binary and trace header data
             // ///////////////////////////////////////
-            struct segy_bin_header_data header_data;
-            header_data.sample_interval = (uint32)(floor(interval * 1000000.0 + 0.5));
-            header_data.sample_interval_reel = header_data.sample_interval;
-
-
-            header_data.job_id = 1;
-            header_data.line_num = 1;
-            header_data.reel_num = 1;
-            header_data.num_of_traces_per_record = num_of_receivers;
-            header_data.num_of_auxiliary_traces_per_record = 0;
-            header_data.data_sample_format = 5;
-            header_data.reel_num = 1;
-            header_data.samples_per_trace = num_of_times;
-            header_data.samples_per_trace_reel = header_data.samples_per_trace;
-            for (int i = 0; i < 17; i++)
-                header_data.other[i] = 0;
-            for (int i = 0; i < 170; i++)
-                header_data.reserve[i] = 0;
-
-            for (IndexType k = 0; k < dims; k++)
-            {
-                seismogramms[dims*path_index + k].header_data = header_data;
-            }
-
-
-
-            // Set trace header data
-            // ///////////////////////////////////////
-
-            // Reading receivers data
-            std::string filename_rec = paths[path_index] + ".receivers.csv";
-            std::ifstream ifs_rec;
-            ifs_rec.open(filename_rec.c_str());
             std::vector<Scalar> rec_x;
             std::vector<Scalar> rec_y;
-            if (ifs_rec)
+            Scalar source_x;
+            Scalar source_y;
+            read_csv_positions(paths[path_index], num_of_receivers, rec_x, rec_y, source_x, source_y);
+            set_segy_headers(dims * path_index, num_of_receivers, rec_x, rec_y, source_x, source_y);
+        }
+    }
+    else if (type == NPY)
+    {
+        seismogramms.resize(paths.size() * dims);
+        for (IndexType path_index = 0; path_index < paths.size(); path_index++)
+        {
+            // Times and components, every component is a (receivers, times) array
+            // ///////////////////////////////////////
+            NpyFile times_file;
+            std::string filename_times = paths[path_index] + ".times.npy";
+            if (!times_file.Open(filename_times))
             {
-                for (IndexType i = 0; i < num_of_receivers; i++)
-                {
-                    std::vector<std::string> v = getNextLineAndSplitIntoTokens(ifs_rec);
-                    if (v.size() < 2)
-                    {
-                        std::cout << "Error while reading receivers data" << std::endl;
-                    }
-                    else
-                    {
-                        rec_x.push_back(::atof(v.at(0).c_str()));
-                        rec_y.push_back(::atof(v.at(1).c_str()));
-                    }
-                }
+                throw std::runtime_error("Error in reading NPY file.\nThere is no such file: " + filename_times);
             }
-            else
+            std::vector<double> npy_times = times_file.ValuesAsDouble();
+            times.assign(npy_times.begin(), npy_times.end());
+            std::vector<IndexType> component_receivers(dims);
+            parallel_for(dims, num_threads, [&](size_t k)
             {
-                std::cout << "Warning: no csv receivers data found" << std::endl;
-                std::cout << "         All receivers positions have been set to (0.0, 0.0)" << std::endl;
-                for (IndexType i = 0; i < num_of_receivers; i++)
-                {
-                    rec_x.push_back(0.0);
-                    rec_y.push_back(0.0);
-                }
-            }
-
-            // Reading source data
-            std::string filename_source = paths[path_index] + ".source.csv";
-            std::ifstream ifs_source;
-            ifs_source.open(filename_source.c_str());
-            Scalar source_x;
-            Scalar source_y;
-            if (ifs_source)
+                std::string filename = paths[path_index] + npy_component_suffixes[k];
+                component_receivers[k] = load_npy_traces(filename, times.size(), seismogramms[dims * path_index + k].data);
+            });
+            const IndexType num_of_receivers = component_receivers[0];
+            for (int k = 0; k < dims; k++)
             {
-                std::vector<std::string> v = getNextLineAndSplitIntoTokens(ifs_source);
-                if (v.size() < 2)
-                {
-                    std::cout << "Error while reading source data" << std::endl;
-                }
-                else
+                if (component_receivers[k] != num_of_receivers)
                 {
-                    source_x = ::atof(v.at(0).c_str());
-                    source_y = ::atof(v.at(1).c_str());
+                    throw std::runtime_error("Error: NPY components have different sizes: " + paths[path_index]);
                 }
             }
-            else
+            IndexType num_of_times = times.size();
+
+            // Interpolating results on eqidistant time grid, unless they are on one already
+            // ///////////////////////////////////////
+            if (needs_resampling())
             {
-                std::cout << "Warning: no csv source data found" << std::endl;
-                std::cout << "         Source position has been set to (0.0, 0.0)" << std::endl;
-                source_x = 0.0;
-                source_y = 0.0;
+                Scalar interval = (times[num_of_times-1] - times[0]) / (num_of_times - 1);
+                interpolate_data_on_equal_time_intervals(interval * interpolation_multiplier);
             }
 
-            // Setting trace headers data
+            // Set binary and trace header data
+            // ///////////////////////////////////////
+            std::vector<Scalar> rec_x;
+            std::vector<Scalar> rec_y;
+            Scalar source_x;
+            Scalar source_y;
+            read_npy_positions(paths[path_index], num_of_receivers, rec_x, rec_y, source_x, source_y);
+            set_segy_headers(dims * path_index, num_of_receivers, rec_x, rec_y, source_x, source_y);
+        }
+    }
+}
 
-            for (IndexType k = 0; k < dims; k++)
-            {
-                seismogramms[dims*path_index + k].trace_header_data.resize(num_of_receivers);
-                for (int i = 0; i < num_of_receivers; i++)
-                {
-                    seismogramms[dims*path_index + k].trace_header_data[i].trace_seq_num_line = i;
-                    seismogramms[dims*path_index + k].trace_header_data[i].trace_seq_num_reel = i;
-                    seismogramms[dims*path_index + k].trace_header_data[i].trace_id_code = i;
-                    seismogramms[dims*path_index + k].trace_header_data[i].receiver_x = rec_x[i];
-                    seismogramms[dims*path_index + k].trace_header_data[i].receiver_y = rec_y[i];
-                    seismogramms[dims*path_index + k].trace_header_data[i].source_x = source_x;
-                    seismogramms[dims*path_index + k].trace_header_data[i].source_y = source_y;
-                    seismogramms[dims*path_index + k].trace_header_data[i].field_record_num = 1;
-                    seismogramms[dims*path_index + k].trace_header_data[i].num_of_samples = header_data.samples_per_trace;
-                    seismogramms[dims*path_index + k].trace_header_data[i].sample_interval = header_data.sample_interval;
-                    seismogramms[dims*path_index + k].trace_header_data[i].trace_num_reel = 1;
-                    seismogramms[dims*path_index + k].trace_header_data[i].units_id = 1;
-                    seismogramms[dims*path_index + k].trace_header_data[i].distance_from_source =
-                            uint32(sqrt(Scalar((rec_x[i]-source_x)*(rec_x[i]-source_x) + (rec_y[i]-source_y)*(rec_y[i]-source_y)) + 0.5));
-                }
-            }
+template <typename Scalar, int dims>
+void CombinedSeismogramm<Scalar, dims>::set_segy_headers(IndexType first_component, IndexType num_of_receivers,
+                                                         const std::vector<Scalar>& rec_x, const std::vector<Scalar>& rec_y,
+                                                         Scalar source_x, Scalar source_y)
+{
+    IndexType num_of_times = times.size();
+    Scalar interval = times[1] - times[0];
+
+    // Set binary header data
+    // ///////////////////////////////////////
+    struct segy_bin_header_data header_data = make_segy_bin_header(num_of_receivers, num_of_times,
+                                                                   interval * 1000000.0, sample_format);
+    for (IndexType k = 0; k < dims; k++)
+    {
+        seismogramms[first_component + k].header_data = header_data;
+    }
 
+    // Setting trace headers data
 
+    for (IndexType k = 0; k < dims; k++)
+    {
+        Seismogramm<Scalar>& seismogramm = seismogramms[first_component + k];
+        seismogramm.trace_header_data.resize(num_of_receivers);
+        for (int i = 0; i < num_of_receivers; i++)
+        {
+            seismogramm.trace_header_data[i] = make_segy_trace_header(i, rec_x[i], rec_y[i], source_x, source_y, header_data);
         }
     }
 }
@@ -427,33 +1095,38 @@ void CombinedSeismogramm<Scalar, dims>::Load(SeismoType type, std::vector<std::s
 template <typename Scalar, int dims>
 void CombinedSeismogramm<Scalar, dims>::interpolate_data_on_equal_time_intervals(Scalar time_interval)
 {
+    // The time grid is shared by all traces, so the resampling plan (bracketing
+    // samples and weights or kernel phases) is computed once; traces of all
+    // components are then resampled in parallel
+    StatsTimer timer(STATS_RESAMPLE);
+    std::unique_ptr<Resampler<Scalar> > resampler(create_resampler<Scalar>(resampling));
+    resampler->Plan(times, time_interval);
+
+    const IndexType trace_block = 16;
+    std::vector<TraceMatrix<Scalar> > interpolated(seismogramms.size());
+    std::vector<std::pair<IndexType, IndexType> > blocks;
     for (IndexType seism_i = 0; seism_i < seismogramms.size(); seism_i++)
     {
-        for (int trace_i = 0; trace_i < seismogramms[seism_i].data.size(); trace_i++)
-        {
-            Scalar cur_time = times[0];
-            IndexType cur_index = 1;
-            typename Seismogramm<Scalar>::Trace temp_trace;
-            while (cur_time < times.back())
-            {
-                while (cur_index < seismogramms[seism_i].data[trace_i].size() && cur_time > times[cur_index])
-                    cur_index++;
-                // Linear approx:
-                temp_trace.push_back(
-                    ((cur_time - times[cur_index-1])*seismogramms[seism_i].data[trace_i][cur_index] +
-                     (times[cur_index] - cur_time)  *seismogramms[seism_i].data[trace_i][cur_index-1]) /
-                     (times[cur_index] - times[cur_index-1]));
-                cur_time += time_interval;
-            }
-            seismogramms[seism_i].data[trace_i].resize(temp_trace.size());
-            for (IndexType time_i = 0; time_i < temp_trace.size(); time_i++)
-            {
-                seismogramms[seism_i].data[trace_i][time_i] = temp_trace[time_i];
-            }
-        }
-        seismogramms[seism_i].header_data.sample_interval = uint16(time_interval * 1000000);
+        interpolated[seism_i].resize(seismogramms[seism_i].data.size(), resampler->OutputSize());
+        for (IndexType trace_i = 0; trace_i < seismogramms[seism_i].data.size(); trace_i += trace_block)
+            blocks.push_back(std::make_pair(seism_i, trace_i));
     }
-    times.resize(seismogramms[0].data[0].size());
+    parallel_for(blocks.size(), num_threads, [&](size_t block_i)
+    {
+        IndexType seism_i = blocks[block_i].first;
+        const TraceMatrix<Scalar>& data = seismogramms[seism_i].data;
+        IndexType trace_end = std::min<size_t>(data.size(), blocks[block_i].second + trace_block);
+        for (IndexType trace_i = blocks[block_i].second; trace_i < trace_end; trace_i++)
+            resampler->Apply(data[trace_i].data(), interpolated[seism_i][trace_i].data());
+    });
+    for (IndexType seism_i = 0; seism_i < seismogramms.size(); seism_i++)
+    {
+        seismogramms[seism_i].data.swap(interpolated[seism_i]);
+        set_segy_sample_interval(seismogramms[seism_i].header_data, time_interval * 1000000);
+        timer.Add(sizeof(Scalar) * seismogramms[seism_i].data.size() * seismogramms[seism_i].data.cols(),
+                  uint64(seismogramms[seism_i].data.size()) * seismogramms[seism_i].data.cols());
+    }
+    times.resize(resampler->OutputSize());
     for (IndexType i = 1; i < times.size(); i++)
         times[i] = times[0] + time_interval * i;
 }
@@ -461,24 +1134,23 @@ void CombinedSeismogramm<Scalar, dims>::interpolate_data_on_equal_time_intervals
 template <typename Scalar, int dims>
 void CombinedSeismogramm<Scalar, dims>::Save(SeismoType type, std::vector<std::string> paths)
 {
+    FlushTimeSteps();
     if (type == SEG_Y)
     {
         if (paths.size()> seismogramms.size())
         {
-            std::cout << "Too many Seg-Y files to save!" << std::endl;
-            std::exit(1);
+            throw std::runtime_error("Too many Seg-Y files to save!");
         }
-        for (IndexType i = 0; i < paths.size(); ++i)
+        parallel_for(paths.size(), num_threads, [&](size_t i)
         {
             seismogramms[i].SaveSegY(paths[i].data(), times);
-        }
+        });
     }
     else if (type == CSV)
     {
         if (paths.size() * dims > 3 * seismogramms.size())
         {
-            std::cout << "Too many Csv files to save!" << std::endl;
-            std::exit(1);
+            throw std::runtime_error("Too many Csv files to save!");
         }
 
         Scalar interval = (times.back() - times.front()) / (times.size() - 1);
@@ -488,29 +1160,29 @@ void CombinedSeismogramm<Scalar, dims>::Save(SeismoType type, std::vector<std::s
         for (IndexType path_index = 0; path_index < paths.size(); path_index++)
         {
             // Saving data
-            std::ofstream outf ((paths[path_index] + ".csv").c_str(), std::ios::out);
-            outf << "Time;";
-            for (int i = 0; i < seismogramms[0].data.size(); i++)
-            {
-                outf << "Vx (edge = " << i + 1 << ");";
-                outf << "Vy (edge = " << i + 1 << ");";
-                if (dims >= 3)
-                    outf << "Vz (edge = " << i + 1 << ");";
-            }
-            outf << "\n";
-            for (int i = 0; i < seismogramms[dims*path_index].data[0].size(); i++)
+            const std::string csv_path = paths[path_index] + (csv_gzip ? ".csv.gz" : ".csv");
+            CsvWriter outf;
+            open_csv_file(outf, csv_path, csv_format, num_threads);
+            write_csv_header(outf, seismogramms[0].data.size(), dims);
+            // Blocks of time steps are transposed into time-major tiles and formatted concurrently
+            const IndexType num_of_receivers = seismogramms[dims*path_index].data.size();
+            const IndexType num_of_times = seismogramms[dims*path_index].data.cols();
+            write_csv_blocks(outf, num_of_times, csv_rows_per_block(num_of_receivers * dims), num_threads,
+                             [&](IndexType begin, IndexType end, CsvWriter& out)
             {
-                outf << times[i] << ";";
-                for (int j = 0; j < seismogramms[dims*path_index].data.size(); j++)
+                static thread_local std::vector<Scalar> tiles[dims];
+                const Scalar * tile_data[dims];
+                for (int k = 0; k < dims; k++)
                 {
-                    outf << seismogramms[dims*path_index + 0].data[j][i] << ";";
-                    outf << seismogramms[dims*path_index + 1].data[j][i] << ";";
-                    if (dims >= 3)
-                        outf << seismogramms[dims*path_index + 2].data[j][i] << ";";
+                    const TraceMatrix<Scalar>& data = seismogramms[dims*path_index + k].data;
+                    tiles[k].resize(size_t(end - begin) * num_of_receivers);
+                    transpose(data.data() + begin, data.stride(), tiles[k].data(), num_of_receivers,
+                              num_of_receivers, end - begin);
+                    tile_data[k] = tiles[k].data();
                 }
-                outf << "\n";
-            }
-            outf.close();
+                write_csv_rows(out, &times[begin], tile_data, end - begin, num_of_receivers, dims);
+            });
+            close_csv_file(outf, csv_path);
             // Saving receivers
             std::ofstream outf_res ((paths[path_index] + ".rec.txt").c_str(), std::ios::out);
             for (int i = 0; i < seismogramms[dims*path_index].trace_header_data.size(); i++)
@@ -526,6 +1198,379 @@ void CombinedSeismogramm<Scalar, dims>::Save(SeismoType type, std::vector<std::s
             outf_expl.close();
         }
     }
+    else if (type == NPY)
+    {
+        if (paths.size() * dims > seismogramms.size())
+        {
+            throw std::runtime_error("Too many Npy files to save!");
+        }
+
+        // Traces already on an equidistant grid are written as they are, bit for bit
+        if (needs_resampling())
+        {
+            Scalar interval = (times.back() - times.front()) / (times.size() - 1);
+            interpolate_data_on_equal_time_intervals(interval * interpolation_multiplier);
+        }
+
+        for (IndexType path_index = 0; path_index < paths.size(); path_index++)
+        {
+            const std::string& path = paths[path_index];
+            const Seismogramm<Scalar>& first = seismogramms[dims*path_index];
+            const IndexType num_of_receivers = first.data.size();
+            std::vector<size_t> shape(1, times.size());
+            write_npy(path + ".times.npy", npy_scalar_descr<Scalar>(), shape,
+                      std::vector<NpyPiece>(1, NpyPiece(times.data(), sizeof(Scalar) * times.size())));
+
+            // Components are written straight from the trace storage, the
+            // padding at the end of traces is skipped
+            parallel_for(dims, num_threads, [&](size_t k)
+            {
+                const TraceMatrix<Scalar>& data = seismogramms[dims*path_index + k].data;
+                std::vector<NpyPiece> pieces;
+                if (data.stride() == data.cols())
+                    pieces.push_back(NpyPiece(data.data(), sizeof(Scalar) * data.size() * data.cols()));
+                else
+                    for (IndexType i = 0; i < data.size(); i++)
+                        pieces.push_back(NpyPiece(data[i].data(), sizeof(Scalar) * data.cols()));
+                std::vector<size_t> shape(2);
+                shape[0] = data.size();
+                shape[1] = data.cols();
+                write_npy(path + npy_component_suffixes[k], npy_scalar_descr<Scalar>(), shape, pieces);
+            });
+
+            // Receivers and source coordinates, as stored in the trace headers
+            std::vector<uint32> receivers(2 * num_of_receivers);
+            for (IndexType i = 0; i < num_of_receivers && i < first.trace_header_data.size(); i++)
+            {
+                receivers[2 * i] = first.trace_header_data[i].receiver_x;
+                receivers[2 * i + 1] = first.trace_header_data[i].receiver_y;
+            }
+            shape.assign(1, num_of_receivers);
+            shape.push_back(2);
+            write_npy(path + ".rec.npy", NPY_NATIVE_UINT32, shape,
+                      std::vector<NpyPiece>(1, NpyPiece(receivers.data(), sizeof(uint32) * receivers.size())));
+            uint32 source[2] = { 0, 0 };
+            if (!first.trace_header_data.empty())
+            {
+                source[0] = first.trace_header_data[0].source_x;
+                source[1] = first.trace_header_data[0].source_y;
+            }
+            shape.assign(1, 2);
+            write_npy(path + ".source.npy", NPY_NATIVE_UINT32, shape, std::vector<NpyPiece>(1, NpyPiece(source, sizeof(source))));
+        }
+    }
+}
+
+template <typename Scalar, int dims>
+void CombinedSeismogramm<Scalar, dims>::ConvertSegYToCsv(std::vector<std::string> segy_paths, std::vector<std::string> csv_paths, size_t max_memory)
+{
+    if (segy_paths.size() != dims * csv_paths.size())
+    {
+        throw std::runtime_error("Number of Seg-Y files doesn't match number of Csv files!");
+    }
+
+    for (IndexType path_index = 0; path_index < csv_paths.size(); path_index++)
+    {
+        // The files are mapped, or with read-ahead read once sequentially with pread
+        const bool read_ahead = segy_read_options.read_ahead > 0;
+        SegYFileView files[dims];
+        std::unique_ptr<ReadAheadFile> ahead_files[dims];
+        segy_bin_header_data bin_headers[dims];
+        IndexType num_of_traces[dims];
+        for (int k = 0; k < dims; k++)
+        {
+            const std::string& path = segy_paths[dims * path_index + k];
+            if (read_ahead)
+            {
+                ahead_files[k].reset(new ReadAheadFile(segy_read_options.block_size, segy_read_options.read_ahead,
+                                                       segy_read_options.io_threads));
+                if (!ahead_files[k]->Open(path))
+                    throw std::runtime_error("Error in reading SEG-Y file.\nThere is no such file: " + path);
+                num_of_traces[k] = read_segy_bin_header(*ahead_files[k], path, bin_headers[k]);
+            }
+            else
+            {
+                open_segy_file(files[k], path);
+                bin_headers[k] = files[k].BinaryHeader();
+                num_of_traces[k] = files[k].NumTraces();
+            }
+            if (num_of_traces[k] != num_of_traces[0] || segy_samples_per_trace(bin_headers[k]) != segy_samples_per_trace(bin_headers[0]))
+            {
+                throw std::runtime_error("Error: SEG-Y components have different sizes: " + path);
+            }
+        }
+        const IndexType num_of_receivers = num_of_traces[0];
+        // Trace headers of the first component, gathered by the read-ahead pass
+        std::vector<segy_trace_header> trace_headers(read_ahead ? num_of_receivers : 0);
+        auto trace_header = [&](IndexType i) { return read_ahead ? trace_headers[i] : files[0].TraceHeader(i); };
+
+        // Setting times exactly as LoadSegY does
+        std::vector<Scalar> in_times;
+        set_segy_times(bin_headers[0], in_times);
+
+        Scalar interval = (in_times.back() - in_times.front()) / (in_times.size() - 1);
+        Scalar time_interval = interval * interpolation_multiplier;
+        std::unique_ptr<Resampler<Scalar> > resampler(create_resampler<Scalar>(resampling));
+        resampler->Plan(in_times, time_interval);
+        std::vector<Scalar> out_times(resampler->OutputSize());
+        for (IndexType i = 0; i < out_times.size(); i++)
+            out_times[i] = (i == 0) ? in_times[0] : in_times[0] + time_interval * i;
+
+        // A tile holds block_size rows of all receivers for one component,
+        // traces are resampled in groups of trace_block and transposed into it.
+        // Read-ahead decodes the inputs of all rows in its pass if they fit with
+        // the tiles, otherwise the decoded traces go to a temporary file (spill)
+        // and every block of rows reads its input samples back from there.
+        const IndexType row_size = num_of_receivers * dims;
+        const size_t row_bytes = sizeof(Scalar) * std::max<size_t>(row_size, 1);
+        const size_t rows_with_inputs = max_memory / (row_bytes * (1.0 + std::max<double>(interpolation_multiplier, 1.0)));
+        const bool spill = read_ahead && rows_with_inputs < out_times.size();
+        const IndexType block_size = std::max<size_t>(1, (read_ahead && !spill) ? out_times.size() : max_memory / row_bytes);
+        const IndexType trace_block = 64;
+        std::vector<Scalar> tiles[dims];
+        for (int k = 0; k < dims; k++)
+            tiles[k].resize(size_t(std::min<size_t>(block_size, out_times.size())) * num_of_receivers);
+        TraceMatrix<Scalar> inputs[dims];
+        TraceRunFile runs[dims];
+        for (int k = 0; read_ahead && k < dims; k++)
+        {
+            const IndexType first_input = spill ? 0 : resampler->FirstInput(0);
+            const IndexType num_of_inputs = spill ? segy_samples_per_trace(bin_headers[k]) :
+                                            resampler->LastInput(out_times.size() - 1) - first_input + 1;
+            const size_t samples_offset = sizeof(segy_trace_header) + sizeof(float) * size_t(first_input);
+            std::vector<Scalar> trace_samples(spill ? num_of_inputs : 0);
+            if (spill)
+            {
+                runs[k].Create(csv_paths[path_index] + ".runs" + std::to_string(k), num_of_receivers, sizeof(Scalar));
+                runs[k].BeginRun(num_of_inputs);
+            }
+            else
+            {
+                inputs[k].resize(num_of_receivers, num_of_inputs);
+            }
+            read_segy_records(*ahead_files[k], segy_data_offset(bin_headers[k]), num_of_receivers,
+                              segy_trace_size(bin_headers[k]), [&](IndexType i, const char * raw)
+            {
+                if (k == 0)
+                {
+                    memcpy(&trace_headers[i], raw, sizeof(segy_trace_header));
+                    swap_segy_trace_header(trace_headers[i]);
+                }
+                Scalar * samples = spill ? trace_samples.data() : inputs[k][i].data();
+                decode_samples(raw + samples_offset, samples, num_of_inputs, bin_headers[k].data_sample_format);
+                if (spill)
+                    runs[k].AppendTrace(samples);
+            });
+            if (spill)
+                runs[k].EndRun();
+            ahead_files[k].reset();
+        }
+
+        const std::string csv_path = csv_paths[path_index] + (csv_gzip ? ".csv.gz" : ".csv");
+        CsvWriter outf;
+        open_csv_file(outf, csv_path, csv_format, num_threads);
+        write_csv_header(outf, num_of_receivers, dims);
+        for (IndexType block_begin = 0; block_begin < out_times.size(); block_begin += block_size)
+        {
+            IndexType block_end = std::min<size_t>(out_times.size(), size_t(block_begin) + block_size);
+            IndexType num_of_rows = block_end - block_begin;
+            // Only the input samples needed for the rows of this tile are decoded
+            const IndexType first_input = resampler->FirstInput(block_begin);
+            const IndexType num_of_inputs = resampler->LastInput(block_end - 1) - first_input + 1;
+            // Blocks of traces are filled concurrently, they touch disjoint columns of the tiles
+            IndexType num_of_trace_blocks = (num_of_receivers + trace_block - 1) / trace_block;
+            parallel_for(num_of_trace_blocks, num_threads, [&](size_t trace_block_index)
+            {
+                IndexType trace_begin = trace_block_index * trace_block;
+                IndexType trace_end = std::min(num_of_receivers, trace_begin + trace_block);
+                static thread_local std::vector<Scalar> window;
+                static thread_local std::vector<Scalar> resampled;
+                window.resize(num_of_inputs);
+                resampled.resize(size_t(trace_block) * num_of_rows);
+                StatsTimer timer(STATS_LOAD, sizeof(float) * num_of_inputs * (trace_end - trace_begin) * dims,
+                                 uint64(num_of_inputs) * (trace_end - trace_begin) * dims);
+                for (int k = 0; k < dims; k++)
+                {
+                    for (IndexType j = trace_begin; j < trace_end; j++)
+                    {
+                        const Scalar * input = window.data();
+                        if (spill)
+                            runs[k].ReadSamples(j, first_input, num_of_inputs, window.data());
+                        else if (read_ahead)
+                            input = inputs[k][j].data();
+                        else
+                            files[k].Trace(j).CopyTo(window.data(), first_input, num_of_inputs);
+                        StatsTimer resample_timer(STATS_RESAMPLE, sizeof(Scalar) * num_of_rows, num_of_rows);
+                        resampler->Apply(input, first_input, &resampled[size_t(j - trace_begin) * num_of_rows],
+                                         block_begin, block_end);
+                    }
+                    transpose(resampled.data(), num_of_rows, &tiles[k][trace_begin], num_of_receivers,
+                              trace_end - trace_begin, num_of_rows);
+                }
+            });
+            for (int k = 0; k < dims; k++)
+            {
+                if (!read_ahead)
+                    files[k].Release();
+            }
+
+            write_csv_blocks(outf, num_of_rows, csv_rows_per_block(row_size), num_threads,
+                             [&](IndexType begin, IndexType end, CsvWriter& out)
+            {
+                const Scalar * tile_data[dims];
+                for (int k = 0; k < dims; k++)
+                    tile_data[k] = &tiles[k][size_t(begin) * num_of_receivers];
+                write_csv_rows(out, &out_times[block_begin + begin], tile_data, end - begin, num_of_receivers, dims);
+            });
+        }
+        close_csv_file(outf, csv_path);
+
+        // Saving receivers
+        std::ofstream outf_res ((csv_paths[path_index] + ".rec.txt").c_str(), std::ios::out);
+        for (IndexType i = 0; i < num_of_receivers; i++)
+        {
+            const segy_trace_header header = trace_header(i);
+            outf_res << header.receiver_x << " " << header.receiver_y << "\n";
+        }
+        outf_res.close();
+        // Saving explosion coords
+        std::ofstream outf_expl ((csv_paths[path_index] + ".expl.txt").c_str(), std::ios::out);
+        if (num_of_receivers > 0)
+        {
+            segy_trace_header first_header = trace_header(0);
+            outf_expl << first_header.source_x << " " << first_header.source_y << "\n";
+        }
+        outf_expl.close();
+    }
+}
+
+template <typename Scalar, int dims>
+void CombinedSeismogramm<Scalar, dims>::ConvertCsvToSegY(std::vector<std::string> csv_paths, std::vector<std::string> segy_paths, size_t max_memory)
+{
+    if (segy_paths.size() != dims * csv_paths.size())
+    {
+        throw std::runtime_error("Number of Seg-Y files doesn't match number of Csv files!");
+    }
+    staged_steps = 0;
+    seismogramms.resize(csv_paths.size() * dims);
+    for (size_t k = 0; k < seismogramms.size(); k++)
+        seismogramms[k].data.clear();
+
+    for (IndexType path_index = 0; path_index < csv_paths.size(); path_index++)
+    {
+        const std::string filename = find_csv_file(csv_paths[path_index]);
+        IndexType num_of_all_traces = 0;
+        IndexType num_of_receivers = 0;
+
+        // Blocks of rows are parsed exactly as Load does and appended to the runs of the
+        // components; the parsed samples of a block take at most about twice its text.
+        // A .csv.gz file holds two blocks of text at once, the parsed and the decompressed one.
+        // ///////////////////////////////////////
+        TraceRunFile runs[dims];
+        const size_t block_text = std::max<size_t>(1, max_memory / (is_gzip_path(filename) ? 4 : 2));
+        std::vector<Scalar> line_times;
+        {
+            TraceMatrix<Scalar> block_data[dims];
+            TraceMatrix<Scalar> * component_data[dims];
+            for (int k = 0; k < dims; k++)
+                component_data[k] = &block_data[k];
+            std::vector<Scalar> block_times;
+            bool header_read = false;
+            for_each_csv_block(filename, block_text, [&](const char * block_begin, const char * block_end)
+            {
+                if (!header_read)
+                {
+                    header_read = true;
+                    block_begin = read_csv_header(block_begin, block_end, dims, num_of_all_traces, num_of_receivers);
+                    for (int k = 0; k < dims; k++)
+                        runs[k].Create(segy_paths[dims * path_index + k] + ".runs", num_of_receivers, sizeof(Scalar));
+                }
+                bool found_short_line = false;
+                const size_t num_of_rows = parse_csv_rows<Scalar, dims>(block_begin, block_end, num_of_all_traces, num_of_receivers,
+                                                                        num_threads, component_data, block_times, &found_short_line);
+                for (int k = 0; k < dims; k++)
+                {
+                    if (num_of_rows > 0)
+                        runs[k].AppendRun(block_data[k].data(), sizeof(Scalar) * block_data[k].stride(), num_of_rows);
+                }
+                line_times.insert(line_times.end(), block_times.begin(), block_times.end());
+                return !found_short_line;
+            });
+        }
+        times.swap(line_times);
+        const size_t num_of_times = times.size();
+
+        // The resampling plan is the one interpolate_data_on_equal_time_intervals makes
+        // ///////////////////////////////////////
+        Scalar interval = (times[num_of_times-1] - times[0]) / (num_of_times - 1);
+        Scalar time_interval = interval * interpolation_multiplier;
+        std::unique_ptr<Resampler<Scalar> > resampler(create_resampler<Scalar>(resampling));
+        resampler->Plan(times, time_interval);
+        times.resize(resampler->OutputSize());
+        for (IndexType i = 1; i < times.size(); i++)
+            times[i] = times[0] + time_interval * i;
+
+        std::vector<Scalar> rec_x;
+        std::vector<Scalar> rec_y;
+        Scalar source_x;
+        Scalar source_y;
+        read_csv_positions(csv_paths[path_index], num_of_receivers, rec_x, rec_y, source_x, source_y);
+        set_segy_headers(dims * path_index, num_of_receivers, rec_x, rec_y, source_x, source_y);
+
+        // Groups of whole traces are read back from the runs, resampled and
+        // appended to the SEG-Y files, so every file is written sequentially.
+        // A trace that alone needs more than max_memory is done in tiles of time,
+        // a tile of outputs takes its inputs, about multiplier times as many
+        // ///////////////////////////////////////
+        const size_t trace_bytes = sizeof(Scalar) * std::max<size_t>(1, num_of_times + resampler->OutputSize());
+        const bool tile_traces = trace_bytes > max_memory;
+        const IndexType group_size = std::max<size_t>(1, std::min<size_t>(num_of_receivers, max_memory / trace_bytes));
+        const size_t tile_size = std::max<size_t>(1, max_memory / (sizeof(Scalar) * (1.0 + std::max<double>(interpolation_multiplier, 1.0))) / 2);
+        const IndexType trace_block = 16;
+        TraceMatrix<Scalar> input, output;
+        if (!tile_traces)
+        {
+            input.resize(group_size, num_of_times);
+            output.resize(group_size, resampler->OutputSize());
+        }
+        for (int k = 0; k < dims; k++)
+        {
+            Seismogramm<Scalar>& seismogramm = seismogramms[dims * path_index + k];
+            const std::string& path = segy_paths[dims * path_index + k];
+            std::ofstream outf (path.data(), std::ios::out | std::ios::binary);
+            if (!outf)
+            {
+                throw std::runtime_error("Error in writing SEG-Y file: " + path);
+            }
+            write_segy_file_header(outf, seismogramm.header_data, false);
+            for (IndexType trace_i = 0; tile_traces && trace_i < num_of_receivers; trace_i++)
+            {
+                write_segy_record_in_tiles(outf, runs[k], trace_i, seismogramm.trace_header_data[trace_i], *resampler, tile_size,
+                                           seismogramm.header_data.data_sample_format);
+            }
+            for (IndexType group_begin = 0; !tile_traces && group_begin < num_of_receivers; group_begin += group_size)
+            {
+                const IndexType num_of_traces = std::min(group_size, num_of_receivers - group_begin);
+                runs[k].ReadTraces(group_begin, num_of_traces, input.data(), sizeof(Scalar) * input.stride());
+                parallel_for((num_of_traces + trace_block - 1) / trace_block, num_threads, [&](size_t block_i)
+                {
+                    IndexType trace_end = std::min<size_t>(num_of_traces, (block_i + 1) * trace_block);
+                    StatsTimer timer(STATS_RESAMPLE, sizeof(Scalar) * output.cols() * (trace_end - block_i * trace_block),
+                                     uint64(output.cols()) * (trace_end - block_i * trace_block));
+                    for (IndexType trace_i = block_i * trace_block; trace_i < trace_end; trace_i++)
+                        resampler->Apply(input[trace_i].data(), output[trace_i].data());
+                });
+                write_segy_records(outf, output, &seismogramm.trace_header_data[group_begin], num_of_traces,
+                                   seismogramm.header_data.data_sample_format);
+            }
+            outf.close();
+            if (!outf)
+            {
+                throw std::runtime_error("Error in writing SEG-Y file: " + path);
+            }
+            runs[k].Close();
+        }
+    }
 }
 
 template <typename Scalar, int dims>
@@ -540,13 +1585,127 @@ void CombinedSeismogramm<Scalar, dims>::Save(SeismoType type)
 template <typename Scalar, int dims>
 void CombinedSeismogramm<Scalar, dims>::AddValue(Scalar time, const Elastic& elastic, IndexType detectorIndex)
 {
-    times.push_back(time);
+    FlushTimeSteps();
+    if (times.empty() || times.back() != time)
+        times.push_back(time);
+    if (seismogramms.size() < componentInfos.size())
+        seismogramms.resize(componentInfos.size());
     for (IndexType i = 0; i < componentInfos.size(); ++i)
     {
         seismogramms[i].AddValue(componentInfos[i].getter->GetValue(elastic), detectorIndex);
     }
 }
 
+template <typename Scalar, int dims>
+void CombinedSeismogramm<Scalar, dims>::Reserve(IndexType num_of_receivers, size_t num_of_times)
+{
+    FlushTimeSteps();
+    if (seismogramms.size() < componentInfos.size())
+        seismogramms.resize(componentInfos.size());
+    for (IndexType k = 0; k < seismogramms.size(); k++)
+    {
+        TraceMatrix<Scalar>& data = seismogramms[k].data;
+        data.resize(std::max<size_t>(data.size(), num_of_receivers), data.cols());
+        data.reserve_cols(num_of_times);
+    }
+    times.reserve(num_of_times);
+}
+
+template <typename Scalar, int dims>
+IndexType CombinedSeismogramm<Scalar, dims>::begin_time_step(Scalar time, size_t num_of_receivers, size_t num_of_components)
+{
+    // Steps of another shape can't share the tiles with the staged ones
+    if (staged_steps > 0 && (staged_tiles.size() != num_of_components ||
+                             staged_tiles[0].size() != size_t(SEISMO_TIME_STEP_BLOCK) * num_of_receivers))
+        FlushTimeSteps();
+    if (staged_steps == 0)
+    {
+        staged_tiles.resize(num_of_components);
+        for (size_t k = 0; k < num_of_components; k++)
+            staged_tiles[k].resize(size_t(SEISMO_TIME_STEP_BLOCK) * num_of_receivers);
+    }
+    times.push_back(time);
+    return staged_steps;
+}
+
+template <typename Scalar, int dims>
+void CombinedSeismogramm<Scalar, dims>::FlushTimeSteps()
+{
+    if (staged_steps == 0)
+        return;
+    const size_t num_of_components = staged_tiles.size();
+    const size_t num_of_receivers = staged_tiles[0].size() / SEISMO_TIME_STEP_BLOCK;
+    const IndexType first_step = times.size() - staged_steps;
+    if (!segy_writers.empty())
+    {
+        // Only the times of the staged steps are kept while recording
+        for (size_t k = 0; k < num_of_components && k < segy_writers.size(); k++)
+        {
+            if (segy_writers[k]->NumReceivers() != num_of_receivers)
+            {
+                throw std::runtime_error("Error in recording SEG-Y files: time steps have another number of receivers than the files");
+            }
+            segy_writers[k]->AddTimeSteps(staged_tiles[k].data(), staged_steps, &times[first_step]);
+        }
+        staged_steps = 0;
+        times.clear();
+        return;
+    }
+    if (seismogramms.size() < num_of_components)
+        seismogramms.resize(num_of_components);
+    for (size_t k = 0; k < num_of_components; k++)
+    {
+        TraceMatrix<Scalar>& data = seismogramms[k].data;
+        if (data.size() != num_of_receivers || data.cols() != first_step)
+            data.resize(num_of_receivers, first_step);
+        data.extend_cols(first_step + staged_steps);
+        transpose(staged_tiles[k].data(), num_of_receivers, data.data() + first_step, data.stride(),
+                  staged_steps, num_of_receivers);
+    }
+    staged_steps = 0;
+}
+
+template <typename Scalar, int dims>
+void CombinedSeismogramm<Scalar, dims>::StartSegYRecording(const std::vector<std::string>& paths, IndexType num_of_receivers,
+                                                           size_t max_num_of_times,
+                                                           const std::vector<Scalar>& rec_x, const std::vector<Scalar>& rec_y,
+                                                           Scalar source_x, Scalar source_y, size_t max_memory)
+{
+    FlushTimeSteps();
+    times.clear();
+    segy_writers.clear();
+    for (size_t k = 0; k < paths.size(); k++)
+    {
+        std::shared_ptr<SegYStreamWriter> writer(new SegYStreamWriter(max_memory / paths.size()));
+        writer->Open(paths[k], num_of_receivers, max_num_of_times, sample_format);
+        writer->SetPositions(rec_x, rec_y, source_x, source_y);
+        segy_writers.push_back(writer);
+    }
+}
+
+template <typename Scalar, int dims>
+void CombinedSeismogramm<Scalar, dims>::FinishSegYRecording()
+{
+    FlushTimeSteps();
+    for (size_t k = 0; k < segy_writers.size(); k++)
+        segy_writers[k]->Finish();
+    segy_writers.clear();
+}
+
+template <typename Scalar, int dims>
+void CombinedSeismogramm<Scalar, dims>::AddTimeStep(Scalar time, Span<const Elastic> receivers)
+{
+    const size_t row_offset = size_t(begin_time_step(time, receivers.size(), componentInfos.size())) * receivers.size();
+    for (IndexType k = 0; k < componentInfos.size(); k++)
+    {
+        const ValueGetter<Elastic, dims>& getter = *componentInfos[k].getter;
+        Scalar * row = staged_tiles[k].data() + row_offset;
+        for (size_t j = 0; j < receivers.size(); j++)
+            row[j] = getter.GetValue(receivers[j]);
+    }
+    end_time_step();
+}
+
 template <typename Scalar, int dims>
 void CombinedSeismogramm<Scalar, dims>::AddComponent(const std::string& path, ValueGetter<Elastic, dims>* getter)
 {
@@ -3,10 +3,16 @@
 
 typedef unsigned int uint32;
 typedef unsigned short uint16;
+typedef unsigned long long uint64;
 typedef unsigned int IndexType;
 
 #include <string>
 #include <vector>
+#include <memory>
+#include <stdint.h>
+#include "trace_matrix.h"
+#include "resample.h"
+#include "csv_writer.h"
 
 struct segy_bin_header_data
 {
@@ -21,11 +27,29 @@ struct segy_bin_header_data
     uint16 samples_per_trace;
     // 	Data sample format code: 1 = IBM floating point (4 bytes) 2 = fixed point (4 bytes)
     //  3 = fixed point (2 bytes) 4 = fixed point with gain code (4 bytes), 5 - IEEE floating point.
+    //  LoadSegY and SaveSegY support 1 and 5.
     uint16 data_sample_format;
     // Skip other data
     uint16 other[17];
+    // SEG-Y rev2 extended fields, they override the 16-bit ones when set.
+    // Use the segy_* helpers of segy_file.h to read and set counts and the interval.
+    uint32 extended_num_of_traces_per_record;
+    uint32 extended_num_of_auxiliary_traces_per_record;
+    uint32 extended_samples_per_trace;
+    double extended_sample_interval; // in microseconds
     // Reserve
-    uint16 reserve[170];
+    uint16 reserve[110];
+    // 0x0100 - rev1, 0x0200 - rev2
+    uint16 segy_revision;
+    uint16 fixed_length_traces;
+    // 3200-byte extended text headers between the binary header and the first trace
+    uint16 num_of_extended_text_headers;
+    // Maximum number of additional trace headers and the time basis code
+    uint16 reserve_rev2[3];
+    uint64 num_of_traces_in_file;
+    // Offset of the first trace in the file, 0 - right after the headers
+    uint64 first_trace_offset;
+    uint16 reserve_rev2_end[36];
 };
 
 struct segy_trace_header
@@ -62,6 +86,54 @@ struct segy_trace_header
 };
 
 
+// How SEG-Y files are read when loading
+struct SegYReadOptions
+{
+    // Blocks of block_size bytes read ahead in the background with pread
+    // on io_threads threads; 0 - the file is memory mapped instead
+    int read_ahead;
+    size_t block_size;
+    int io_threads;
+
+    SegYReadOptions(int read_ahead = 0, size_t block_size = 4 * 1024 * 1024, int io_threads = 2) :
+        read_ahead(read_ahead), block_size(block_size), io_threads(io_threads) {}
+};
+
+// Part of a SEG-Y file to load: a range of traces and the samples of a time window
+struct SegYWindow
+{
+    // Traces [first_trace, first_trace + num_traces), 0 - up to the last trace
+    IndexType first_trace;
+    IndexType num_traces;
+    // Samples with times inside [start_time, end_time] seconds, end_time < 0 - up to the last sample
+    double start_time;
+    double end_time;
+
+    SegYWindow(IndexType first_trace = 0, IndexType num_traces = 0, double start_time = 0.0, double end_time = -1.0) :
+        first_trace(first_trace), num_traces(num_traces), start_time(start_time), end_time(end_time) {}
+
+    bool IsWhole() const { return first_trace == 0 && num_traces == 0 && start_time <= 0.0 && end_time < 0.0; }
+};
+
+// Traces of a SEG-Y file selected through its index (<file>.idx) by the receiver
+// position and the distance from the source, both ranges inclusive
+struct SegYTraceQuery
+{
+    bool by_receiver;
+    uint32 receiver_x_min, receiver_x_max;
+    uint32 receiver_y_min, receiver_y_max;
+    bool by_offset;
+    uint32 min_offset, max_offset;
+
+    SegYTraceQuery() : by_receiver(false), receiver_x_min(0), receiver_x_max(UINT32_MAX), receiver_y_min(0),
+        receiver_y_max(UINT32_MAX), by_offset(false), min_offset(0), max_offset(UINT32_MAX) {}
+
+    bool IsEmpty() const { return !by_receiver && !by_offset; }
+};
+
+class SegYIndex;
+class SegYStreamWriter;
+
 template <typename Scalar>
 class Seismogramm
 {
@@ -69,15 +141,23 @@ public:
 
     typedef Scalar Sample;
 
-    typedef std::vector<Sample> Trace;
+    typedef typename TraceMatrix<Sample>::Row Trace;
 
     Seismogramm() {}
 
-    void LoadSegY(const std::string& path, std::vector<Scalar>& times);
-    void SaveSegY(const std::string& path, const std::vector<Scalar>& times, bool save_empty_headers = false);
+    // With a window only its traces and samples are read from the file; times start at the
+    // first sample of the window and the headers describe the loaded part
+    void LoadSegY(const std::string& path, std::vector<Scalar>& times, const SegYReadOptions& options = SegYReadOptions(),
+                  const SegYWindow& window = SegYWindow());
+    // Loads only the given traces (numbers of index entries, e.g. found by an index query)
+    // of the SEG-Y file the index describes, in the given order, reading them directly
+    void LoadSegYTraces(const std::string& path, const SegYIndex& index, const std::vector<IndexType>& traces,
+                        std::vector<Scalar>& times);
+    void SaveSegY(const std::string& path, const std::vector<Scalar>& times, bool save_empty_headers = false) const;
     void AddValue(const Sample& value, IndexType detectorIndex);
 
-    std::vector<Trace> data;
+    // data[i] is the i-th trace, all traces have data.cols() samples
+    TraceMatrix<Sample> data;
     struct segy_bin_header_data header_data;
 
     std::vector<struct segy_trace_header> trace_header_data;
@@ -87,15 +167,18 @@ public:
 
 private:
 
-    void swap_header_endian();
-    void swap_trace_header_endian(struct segy_trace_header * ptr_header);
-    void swap_all_trace_headers_endian();
-    void swap_data_endian();
+    void load_segy_read_ahead(const std::string& path, const SegYReadOptions& options);
+    void load_segy_window(const std::string& path, const SegYWindow& window, std::vector<Scalar>& times);
+
+    // Number of samples recorded by AddValue for every trace
+    std::vector<IndexType> trace_lengths;
 };
 
+// NPY: NumPy arrays <path>_x.npy, <path>_y.npy (, <path>_z.npy) of shape
+// (receivers, times) with <path>.times.npy, <path>.rec.npy and <path>.source.npy
 enum SeismoType
 {
-    SEG_Y, CSV
+    SEG_Y, CSV, NPY
 };
 
 // ////////////////////////////////////////////////////////
@@ -206,6 +289,9 @@ struct PressureGetter<Elastic, 3>: public ValueGetter<Elastic, 3>
 
 // ////////////////////////////////////////////////////////////////////
 
+// Time steps recorded by AddTimeStep that are staged before being moved into the traces
+#define SEISMO_TIME_STEP_BLOCK 64
+
 template <typename Scalar, int dims>
 class CombinedSeismogramm
 {
@@ -215,6 +301,21 @@ public:
     std::vector<Scalar> times;
     std::vector<Seismogramm<Scalar> > seismogramms;
     Scalar interpolation_multiplier;
+    // How traces are resampled onto the equidistant time grid
+    ResamplingType resampling;
+    // Data sample format of SEG-Y files created from CSV: 1 (IBM) or 5 (IEEE)
+    int sample_format;
+    // Threads used for loading, saving and converting, 0 - one per hardware thread
+    int num_threads;
+    // How samples and times are printed into CSV files
+    CsvNumberFormat csv_format;
+    // Whether CSV files are written compressed as <path>.csv.gz
+    bool csv_gzip;
+    // How SEG-Y files are read by Load and which part of them is loaded
+    SegYReadOptions segy_read_options;
+    SegYWindow segy_window;
+    // With a query Load reads only the matching traces through the indexes of the files
+    SegYTraceQuery segy_query;
 
     struct Elastic
     {
@@ -234,20 +335,108 @@ public:
 
     std::vector<ComponentInfo> componentInfos;
 
-    CombinedSeismogramm(Scalar interpolation_multiplier = 1) : interpolation_multiplier(interpolation_multiplier) {}
+    CombinedSeismogramm(Scalar interpolation_multiplier = 1) : interpolation_multiplier(interpolation_multiplier),
+        resampling(LINEAR_RESAMPLING), sample_format(5), num_threads(0), csv_gzip(false), staged_steps(0) {}
 
+    // Loading, saving and converting throw std::runtime_error on failure.
+    // SEG-Y components are loaded concurrently; if several fail, the error
+    // of the first failed component is reported.
     void Load(SeismoType type, std::vector<std::string> paths);
 
     void Save(SeismoType type, std::vector<std::string> paths);
     void Save(SeismoType type);
 
+    // Same result as Load(SEG_Y, segy_paths) followed by Save(CSV, csv_paths), but the
+    // components are never loaded completely: rows are produced in tiles of traces x time
+    // samples and the tile being written takes at most max_memory bytes.
+    void ConvertSegYToCsv(std::vector<std::string> segy_paths, std::vector<std::string> csv_paths, size_t max_memory);
+
+    // Same result as Load(CSV, csv_paths) followed by Save(SEG_Y, segy_paths) for CSV files
+    // bigger than memory: blocks of rows of about max_memory / 2 bytes of text are parsed
+    // and appended trace-major to temporary run files next to the SEG-Y files, which are
+    // then read back a group of whole traces at a time and written out sequentially.
+    // Only the headers and times are kept in the seismogramms, not the samples.
+    void ConvertCsvToSegY(std::vector<std::string> csv_paths, std::vector<std::string> segy_paths, size_t max_memory);
+
+    // Records the value of one detector; the first value with a new time starts a new time step
     void AddValue(Scalar time, const Elastic& elastic, IndexType detectorIndex);
 
+    // Makes room for num_of_times time steps of num_of_receivers receivers in every component,
+    // so that recording them with AddTimeStep doesn't reallocate
+    void Reserve(IndexType num_of_receivers, size_t num_of_times);
+
+    // Records one time step of all receivers, receivers[j] is the value at receiver j.
+    // Components get their values from the getters added with AddComponent.
+    // Time steps are staged time-major and moved into the traces SEISMO_TIME_STEP_BLOCK
+    // steps at a time; Save and FlushTimeSteps move the rest, call FlushTimeSteps
+    // before reading seismogramms directly.
+    void AddTimeStep(Scalar time, Span<const Elastic> receivers);
+
+    // Same with getters known at compile time, component k gets its values from
+    // the k-th getter type, e.g. AddTimeStep<VxGetter<Elastic, 2>, VyGetter<Elastic, 2> >(...).
+    // The getters are inlined and every receiver is stored into all components at once.
+    template <typename... Getters>
+    void AddTimeStep(Scalar time, Span<const Elastic> receivers);
+
+    // Moves the staged time steps into the traces, or into the files being recorded
+    void FlushTimeSteps();
+
+    // Records the time steps of AddTimeStep straight into SEG-Y files, one per
+    // component, instead of keeping them in memory. The files are created for
+    // num_of_receivers traces of up to max_num_of_times samples; at most
+    // max_memory bytes of samples are buffered. FinishSegYRecording completes the files.
+    void StartSegYRecording(const std::vector<std::string>& paths, IndexType num_of_receivers, size_t max_num_of_times,
+                            const std::vector<Scalar>& rec_x, const std::vector<Scalar>& rec_y,
+                            Scalar source_x, Scalar source_y, size_t max_memory = 256 * 1024 * 1024);
+    void FinishSegYRecording();
+
     void AddComponent(const std::string& path, ValueGetter<Elastic, dims>* getter);
 
-private:
+    // Resamples the traces of all components onto times[0] + i * time_interval; Load and
+    // Save(CSV) call it with the mean interval times interpolation_multiplier
     void interpolate_data_on_equal_time_intervals(Scalar time_interval);
 
+private:
+    // Whether NPY traces have to be resampled: the multiplier changes the interval or the times aren't equidistant
+    bool needs_resampling() const { return interpolation_multiplier != 1 || !is_uniform_time_grid(times); }
+    // Starts a time step of num_of_receivers samples for the first num_of_components
+    // components, returns the row of the step in the staged tiles
+    IndexType begin_time_step(Scalar time, size_t num_of_receivers, size_t num_of_components);
+    void end_time_step()
+    {
+        if (++staged_steps == SEISMO_TIME_STEP_BLOCK)
+            FlushTimeSteps();
+    }
+
+    // Time-major tiles of the time steps that haven't been moved into the traces yet
+    std::vector<std::vector<Scalar> > staged_tiles;
+    IndexType staged_steps;
+    // Files of the components while recording
+    std::vector<std::shared_ptr<SegYStreamWriter> > segy_writers;
+    // Builds SEG-Y headers of the dims components starting at first_component for the current times
+    void set_segy_headers(IndexType first_component, IndexType num_of_receivers,
+                          const std::vector<Scalar>& rec_x, const std::vector<Scalar>& rec_y,
+                          Scalar source_x, Scalar source_y);
+
 };
 
+template <typename Scalar, int dims>
+template <typename... Getters>
+void CombinedSeismogramm<Scalar, dims>::AddTimeStep(Scalar time, Span<const Elastic> receivers)
+{
+    const size_t num_of_components = sizeof...(Getters);
+    static_assert(num_of_components > 0, "AddTimeStep needs at least one getter");
+    const size_t row_offset = size_t(begin_time_step(time, receivers.size(), num_of_components)) * receivers.size();
+    Scalar * rows[num_of_components];
+    for (size_t k = 0; k < num_of_components; k++)
+        rows[k] = staged_tiles[k].data() + row_offset;
+    for (size_t j = 0; j < receivers.size(); j++)
+    {
+        const Elastic& elastic = receivers[j];
+        size_t k = 0;
+        ((rows[k++][j] = Getters().GetValue(elastic)), ...);
+    }
+    end_time_step();
+}
+
 #endif // SEGY_H
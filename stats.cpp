@@ -0,0 +1,141 @@
+#include "stats.h"
+#include <stdio.h>
+#include <algorithm>
+
+bool stats_on = false;
+
+// Counters of a stage on their own cache line, so threads busy with
+// different stages don't contend
+struct alignas(64) StageCounters
+{
+    std::atomic<uint64_t> nanoseconds;
+    std::atomic<uint64_t> calls;
+    std::atomic<uint64_t> bytes;
+    std::atomic<uint64_t> samples;
+};
+
+static StageCounters stage_counters[STATS_NUM_STAGES];
+
+const char* stats_stage_name(StatsStage stage)
+{
+    const char * names[STATS_NUM_STAGES] = { "load", "resample", "swap", "format", "write", "gzip" };
+    return names[stage];
+}
+
+void stats_add(StatsStage stage, uint64_t nanoseconds, uint64_t bytes, uint64_t samples)
+{
+    StageCounters& counters = stage_counters[stage];
+    counters.nanoseconds.fetch_add(nanoseconds, std::memory_order_relaxed);
+    counters.calls.fetch_add(1, std::memory_order_relaxed);
+    if (bytes)
+        counters.bytes.fetch_add(bytes, std::memory_order_relaxed);
+    if (samples)
+        counters.samples.fetch_add(samples, std::memory_order_relaxed);
+}
+
+StatsCounters stats_counters(StatsStage stage)
+{
+    const StageCounters& counters = stage_counters[stage];
+    StatsCounters result;
+    result.nanoseconds = counters.nanoseconds.load(std::memory_order_relaxed);
+    result.calls = counters.calls.load(std::memory_order_relaxed);
+    result.bytes = counters.bytes.load(std::memory_order_relaxed);
+    result.samples = counters.samples.load(std::memory_order_relaxed);
+    return result;
+}
+
+void stats_reset()
+{
+    for (int i = 0; i < STATS_NUM_STAGES; i++)
+    {
+        stage_counters[i].nanoseconds = 0;
+        stage_counters[i].calls = 0;
+        stage_counters[i].bytes = 0;
+        stage_counters[i].samples = 0;
+    }
+}
+
+bool write_stats_json(const std::string& path, double wall_seconds, int num_threads, uint64_t input_bytes)
+{
+    FILE * out = (path == "-") ? stdout : fopen(path.c_str(), "w");
+    if (!out)
+        return false;
+    fprintf(out, "{\n");
+    fprintf(out, "  \"wall_seconds\": %.6f,\n", wall_seconds);
+    fprintf(out, "  \"threads\": %d,\n", num_threads);
+    fprintf(out, "  \"input_bytes\": %llu,\n", (unsigned long long)input_bytes);
+    fprintf(out, "  \"stages\": {\n");
+    for (int i = 0; i < STATS_NUM_STAGES; i++)
+    {
+        const StatsCounters counters = stats_counters(StatsStage(i));
+        const double seconds = counters.nanoseconds * 1e-9;
+        const double rate_time = std::max(seconds, 1e-9);
+        fprintf(out, "    \"%s\": { \"thread_seconds\": %.6f, \"calls\": %llu, \"bytes\": %llu, \"samples\": %llu, "
+                "\"mb_per_s\": %.3f, \"samples_per_s\": %.1f }%s\n",
+                stats_stage_name(StatsStage(i)), seconds, (unsigned long long)counters.calls,
+                (unsigned long long)counters.bytes, (unsigned long long)counters.samples,
+                (seconds > 0.0) ? counters.bytes / rate_time / (1024.0 * 1024.0) : 0.0,
+                (seconds > 0.0) ? counters.samples / rate_time : 0.0,
+                (i + 1 < STATS_NUM_STAGES) ? "," : "");
+    }
+    fprintf(out, "  }\n");
+    fprintf(out, "}\n");
+    bool ok = !ferror(out);
+    if (out != stdout)
+        ok = (fclose(out) == 0) && ok;
+    else
+        fflush(out);
+    return ok;
+}
+
+StatsProgress::StatsProgress(double period, uint64_t total_bytes) :
+    period(period), total_bytes(total_bytes), start(std::chrono::steady_clock::now()), stopping(false), printed(false)
+{
+    reporter = std::thread([this]()
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        const std::chrono::duration<double> wait(this->period);
+        while (!wake.wait_for(guard, wait, [this]() { return stopping; }))
+        {
+            print_line(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+            printed = true;
+        }
+    });
+}
+
+StatsProgress::~StatsProgress()
+{
+    Stop();
+}
+
+void StatsProgress::Stop()
+{
+    if (!reporter.joinable())
+        return;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+    }
+    wake.notify_all();
+    reporter.join();
+    if (printed)
+        fprintf(stderr, "\n");
+}
+
+void StatsProgress::print_line(double seconds) const
+{
+    const uint64_t loaded = stats_counters(STATS_LOAD).bytes;
+    const double mb = loaded / (1024.0 * 1024.0);
+    const double rate = (seconds > 0.0) ? mb / seconds : 0.0;
+    if (total_bytes > 0)
+    {
+        const double done = std::min(1.0, double(loaded) / total_bytes);
+        const double remaining = (loaded > 0) ? seconds * (1.0 - done) / done : 0.0;
+        fprintf(stderr, "\r%5.1f%%  %.1f MB loaded  %.1f MB/s  ETA %.0f s   ", 100.0 * done, mb, rate, remaining);
+    }
+    else
+    {
+        fprintf(stderr, "\r%.1f MB loaded  %.1f MB/s   ", mb, rate);
+    }
+    fflush(stderr);
+}
@@ -0,0 +1,111 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <string>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <stdint.h>
+
+// Stages of a conversion that are timed for --stats. Stages may contain each other:
+// loading a SEG-Y file includes the swap of its samples, tocsv loads and resamples
+// traces in the same pass. gzip counts the text of .csv.gz files compressed and decompressed.
+enum StatsStage
+{
+    STATS_LOAD, STATS_RESAMPLE, STATS_SWAP, STATS_FORMAT, STATS_WRITE, STATS_GZIP, STATS_NUM_STAGES
+};
+
+const char* stats_stage_name(StatsStage stage);
+
+// Counters of a stage summed over all threads, so seconds are thread-seconds
+struct StatsCounters
+{
+    uint64_t nanoseconds;
+    uint64_t calls;
+    uint64_t bytes;
+    uint64_t samples;
+};
+
+// Nothing is counted until stats_enable(true), then a timer costs two clock
+// reads and a few relaxed atomic adds
+extern bool stats_on;
+inline void stats_enable(bool enable) { stats_on = enable; }
+
+void stats_add(StatsStage stage, uint64_t nanoseconds, uint64_t bytes, uint64_t samples);
+StatsCounters stats_counters(StatsStage stage);
+void stats_reset();
+
+// Writes the counters of all stages as JSON to path ("-" - stdout),
+// returns false if the file couldn't be written
+bool write_stats_json(const std::string& path, double wall_seconds, int num_threads, uint64_t input_bytes);
+
+// Adds the time from construction to destruction and the given bytes and samples to a stage
+class StatsTimer
+{
+public:
+
+    explicit StatsTimer(StatsStage stage, uint64_t bytes = 0, uint64_t samples = 0) :
+        stage(stage), bytes(bytes), samples(samples)
+    {
+        if (stats_on)
+            start = std::chrono::steady_clock::now();
+    }
+    ~StatsTimer()
+    {
+        if (stats_on)
+        {
+            std::chrono::nanoseconds time = std::chrono::steady_clock::now() - start;
+            stats_add(stage, time.count(), bytes, samples);
+        }
+    }
+
+    // Counts more data handled by the timed code
+    void Add(uint64_t more_bytes, uint64_t more_samples)
+    {
+        bytes += more_bytes;
+        samples += more_samples;
+    }
+
+private:
+
+    StatsTimer(const StatsTimer&);
+    StatsTimer& operator=(const StatsTimer&);
+
+    StatsStage stage;
+    uint64_t bytes;
+    uint64_t samples;
+    std::chrono::steady_clock::time_point start;
+};
+
+// Prints a line with the loaded bytes, throughput and ETA to stderr every
+// period seconds on a background thread, until it is stopped or destroyed.
+// total_bytes - input expected to be loaded, 0 if unknown (no percentage and ETA).
+class StatsProgress
+{
+public:
+
+    StatsProgress(double period, uint64_t total_bytes);
+    ~StatsProgress();
+
+    void Stop();
+
+private:
+
+    StatsProgress(const StatsProgress&);
+    StatsProgress& operator=(const StatsProgress&);
+
+    void print_line(double seconds) const;
+
+    double period;
+    uint64_t total_bytes;
+    std::chrono::steady_clock::time_point start;
+    bool stopping;
+    bool printed;
+    std::mutex lock;
+    std::condition_variable wake;
+    std::thread reporter;
+};
+
+#endif // STATS_H
@@ -0,0 +1,205 @@
+#ifndef TRACE_MATRIX_H
+#define TRACE_MATRIX_H
+
+#include <cstddef>
+#include <cstdlib>
+#include <string.h>
+#include <algorithm>
+#include <new>
+
+// Non-owning view of count consecutive elements
+template <typename T>
+class Span
+{
+public:
+
+    typedef T value_type;
+
+    Span() : ptr(0), count(0) {}
+    Span(T * ptr, size_t count) : ptr(ptr), count(count) {}
+
+    T& operator[](size_t i) const { return ptr[i]; }
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    T* data() const { return ptr; }
+    T* begin() const { return ptr; }
+    T* end() const { return ptr + count; }
+
+private:
+
+    T * ptr;
+    size_t count;
+};
+
+// Traces of one seismogram stored in a single aligned block.
+// Trace i starts at data() + i * stride(); the stride is cols() rounded up to
+// TRACE_MATRIX_ALIGNMENT bytes, so every trace is aligned for vector loads.
+// Growing cols() past the stride reallocates geometrically, which keeps
+// appending samples one time step at a time cheap.
+#define TRACE_MATRIX_ALIGNMENT 64
+
+template <typename T>
+class TraceMatrix
+{
+public:
+
+    typedef Span<T> Row;
+    typedef Span<const T> ConstRow;
+
+    TraceMatrix() : values(0), num_rows(0), num_cols(0), row_stride(0), capacity_rows(0) {}
+    TraceMatrix(size_t rows, size_t cols) : values(0), num_rows(0), num_cols(0), row_stride(0), capacity_rows(0)
+    {
+        resize(rows, cols);
+    }
+    TraceMatrix(const TraceMatrix& other) : values(0), num_rows(0), num_cols(0), row_stride(0), capacity_rows(0)
+    {
+        *this = other;
+    }
+    TraceMatrix(TraceMatrix&& other) : values(0), num_rows(0), num_cols(0), row_stride(0), capacity_rows(0)
+    {
+        swap(other);
+    }
+    ~TraceMatrix()
+    {
+        ::free(values);
+    }
+
+    TraceMatrix& operator=(const TraceMatrix& other)
+    {
+        if (this != &other)
+        {
+            TraceMatrix copy;
+            copy.allocate(other.num_rows, other.row_stride);
+            copy.num_rows = other.num_rows;
+            copy.num_cols = other.num_cols;
+            if (other.values)
+                memcpy(copy.values, other.values, sizeof(T) * other.num_rows * other.row_stride);
+            swap(copy);
+        }
+        return *this;
+    }
+    TraceMatrix& operator=(TraceMatrix&& other)
+    {
+        swap(other);
+        return *this;
+    }
+
+    void swap(TraceMatrix& other)
+    {
+        std::swap(values, other.values);
+        std::swap(num_rows, other.num_rows);
+        std::swap(num_cols, other.num_cols);
+        std::swap(row_stride, other.row_stride);
+        std::swap(capacity_rows, other.capacity_rows);
+    }
+
+    // Number of traces
+    size_t size() const { return num_rows; }
+    size_t rows() const { return num_rows; }
+    // Number of samples in every trace
+    size_t cols() const { return num_cols; }
+    // Distance between the beginnings of two consecutive traces, in elements
+    size_t stride() const { return row_stride; }
+    // Number of elements the storage holds
+    size_t capacity() const { return capacity_rows * row_stride; }
+    bool empty() const { return num_rows == 0; }
+
+    T* data() { return values; }
+    const T* data() const { return values; }
+
+    Row operator[](size_t i) { return Row(values + i * row_stride, num_cols); }
+    ConstRow operator[](size_t i) const { return ConstRow(values + i * row_stride, num_cols); }
+
+    // Changes the shape keeping the overlapping samples, new samples are zero
+    void resize(size_t rows, size_t cols)
+    {
+        if (cols > row_stride || rows > capacity_rows)
+        {
+            size_t stride = row_stride;
+            if (cols > stride)
+            {
+                // Grow geometrically only if some samples are already there
+                stride = round_up((num_cols > 0) ? std::max(cols, stride + stride / 2) : cols);
+            }
+            size_t capacity = capacity_rows;
+            if (rows > capacity)
+            {
+                // The same for traces, so that adding them one by one is amortized O(1)
+                capacity = (num_rows > 0) ? std::max(rows, capacity + capacity / 2) : rows;
+            }
+            reallocate(capacity, stride);
+        }
+        // Zeroing the samples that become visible
+        if (cols > num_cols)
+            for (size_t i = 0; i < std::min(rows, num_rows); i++)
+                memset(values + i * row_stride + num_cols, 0, sizeof(T) * (cols - num_cols));
+        if (rows > num_rows)
+            memset(values + num_rows * row_stride, 0, sizeof(T) * (rows - num_rows) * row_stride);
+        num_rows = rows;
+        num_cols = cols;
+    }
+    void resize(size_t rows)
+    {
+        resize(rows, num_cols);
+    }
+    // Grows cols() like resize, but the new samples are left uninitialized
+    // for callers that write all of them right away
+    void extend_cols(size_t cols)
+    {
+        if (cols > row_stride)
+            reallocate(capacity_rows, round_up((num_cols > 0) ? std::max(cols, row_stride + row_stride / 2) : cols));
+        num_cols = std::max(num_cols, cols);
+    }
+    // Makes room for cols samples per trace without changing the shape
+    void reserve_cols(size_t cols)
+    {
+        if (cols > row_stride)
+            reallocate(capacity_rows, round_up(cols));
+    }
+    void clear()
+    {
+        num_rows = 0;
+        num_cols = 0;
+    }
+
+private:
+
+    static size_t round_up(size_t cols)
+    {
+        const size_t step = TRACE_MATRIX_ALIGNMENT / sizeof(T) > 0 ? TRACE_MATRIX_ALIGNMENT / sizeof(T) : 1;
+        return (cols + step - 1) / step * step;
+    }
+
+    void allocate(size_t rows, size_t stride)
+    {
+        values = 0;
+        capacity_rows = rows;
+        row_stride = stride;
+        size_t bytes = sizeof(T) * rows * stride;
+        if (bytes > 0)
+        {
+            void * ptr = 0;
+            if (::posix_memalign(&ptr, TRACE_MATRIX_ALIGNMENT, bytes) != 0)
+                throw std::bad_alloc();
+            values = static_cast<T*>(ptr);
+        }
+    }
+
+    void reallocate(size_t rows, size_t stride)
+    {
+        T * old_values = values;
+        size_t old_stride = row_stride;
+        allocate(rows, stride);
+        for (size_t i = 0; i < num_rows; i++)
+            memcpy(values + i * row_stride, old_values + i * old_stride, sizeof(T) * num_cols);
+        ::free(old_values);
+    }
+
+    T * values;
+    size_t num_rows;
+    size_t num_cols;
+    size_t row_stride;
+    size_t capacity_rows;
+};
+
+#endif // TRACE_MATRIX_H
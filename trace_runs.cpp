@@ -0,0 +1,170 @@
+#include "trace_runs.h"
+#include "stats.h"
+#include <stdexcept>
+#include <algorithm>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+// Bytes moved by one system call while writing and reading runs
+#define TRACE_RUNS_IO_SIZE (8 * 1024 * 1024)
+
+TraceRunFile::TraceRunFile() : fd(-1), num_of_traces(0), sample_size(0), num_of_samples(0), file_end(0)
+{
+}
+
+TraceRunFile::~TraceRunFile()
+{
+    Close();
+}
+
+void TraceRunFile::Create(const std::string& path, IndexType num_of_traces, size_t sample_size)
+{
+    Close();
+    this->path = path;
+    this->num_of_traces = num_of_traces;
+    this->sample_size = sample_size;
+    num_of_samples = 0;
+    file_end = 0;
+    run_offsets.clear();
+    run_samples.clear();
+
+    fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+    if (fd < 0)
+        throw std::runtime_error("Error in creating temporary file: " + path + ": " + strerror(errno));
+    ::unlink(path.c_str());
+}
+
+void TraceRunFile::Close()
+{
+    if (fd >= 0)
+        ::close(fd);
+    fd = -1;
+}
+
+void TraceRunFile::AppendRun(const void * data, size_t stride, size_t num_of_samples)
+{
+    const char * in = static_cast<const char*>(data);
+    const size_t piece = sample_size * num_of_samples;
+    run_offsets.push_back(file_end);
+    run_samples.push_back(num_of_samples);
+    this->num_of_samples += num_of_samples;
+
+    // Traces are packed together and written in large sequential pieces
+    const IndexType traces_per_write = std::max<size_t>(1, TRACE_RUNS_IO_SIZE / std::max<size_t>(piece, 1));
+    for (IndexType first = 0; first < num_of_traces; first += traces_per_write)
+    {
+        const IndexType last = std::min(num_of_traces, first + traces_per_write);
+        const size_t count = piece * (last - first);
+        if (stride == piece)
+        {
+            write_at(in + size_t(first) * stride, count, file_end);
+        }
+        else
+        {
+            buffer.resize(count);
+            for (IndexType i = first; i < last; i++)
+                memcpy(&buffer[piece * (i - first)], in + size_t(i) * stride, piece);
+            write_at(buffer.data(), count, file_end);
+        }
+        file_end += count;
+    }
+}
+
+void TraceRunFile::BeginRun(size_t num_of_samples)
+{
+    run_offsets.push_back(file_end);
+    run_samples.push_back(num_of_samples);
+    this->num_of_samples += num_of_samples;
+    buffer.clear();
+}
+
+void TraceRunFile::AppendTrace(const void * samples)
+{
+    const char * in = static_cast<const char*>(samples);
+    buffer.insert(buffer.end(), in, in + sample_size * run_samples.back());
+    if (buffer.size() >= TRACE_RUNS_IO_SIZE)
+        EndRun();
+}
+
+void TraceRunFile::EndRun()
+{
+    write_at(buffer.data(), buffer.size(), file_end);
+    file_end += buffer.size();
+    buffer.clear();
+}
+
+void TraceRunFile::ReadTraces(IndexType first, IndexType count, void * out, size_t stride)
+{
+    char * traces = static_cast<char*>(out);
+    size_t run_begin = 0;
+    for (size_t run = 0; run < run_offsets.size(); run++)
+    {
+        // The traces are next to each other in every run, so they are read with a few large reads
+        const size_t piece = sample_size * run_samples[run];
+        const IndexType traces_per_read = std::max<size_t>(1, TRACE_RUNS_IO_SIZE / std::max<size_t>(piece, 1));
+        for (IndexType i = 0; i < count; i += traces_per_read)
+        {
+            const IndexType num = std::min(count - i, traces_per_read);
+            buffer.resize(piece * num);
+            read_at(buffer.data(), buffer.size(), run_offsets[run] + uint64(first + i) * piece);
+            for (IndexType j = 0; j < num; j++)
+                memcpy(traces + size_t(i + j) * stride + sample_size * run_begin, &buffer[piece * j], piece);
+        }
+        run_begin += run_samples[run];
+    }
+}
+
+void TraceRunFile::ReadSamples(IndexType trace, size_t first_sample, size_t count, void * out)
+{
+    char * samples = static_cast<char*>(out);
+    size_t run_begin = 0;
+    for (size_t run = 0; run < run_offsets.size() && count > 0; run++)
+    {
+        const size_t run_end = run_begin + run_samples[run];
+        if (first_sample < run_end)
+        {
+            const size_t num = std::min(count, run_end - first_sample);
+            read_at(samples, sample_size * num, run_offsets[run] + uint64(trace) * sample_size * run_samples[run] +
+                    sample_size * (first_sample - run_begin));
+            samples += sample_size * num;
+            first_sample += num;
+            count -= num;
+        }
+        run_begin = run_end;
+    }
+}
+
+void TraceRunFile::write_at(const void * data, size_t count, uint64 offset)
+{
+    StatsTimer timer(STATS_WRITE, count, 0);
+    const char * in = static_cast<const char*>(data);
+    while (count > 0)
+    {
+        ssize_t done = ::pwrite(fd, in, count, offset);
+        if (done < 0 && errno == EINTR)
+            continue;
+        if (done <= 0)
+            throw std::runtime_error("Error in writing temporary file: " + path + ": " + strerror(errno));
+        in += done;
+        offset += done;
+        count -= done;
+    }
+}
+
+void TraceRunFile::read_at(void * data, size_t count, uint64 offset)
+{
+    char * out = static_cast<char*>(data);
+    while (count > 0)
+    {
+        ssize_t done = ::pread(fd, out, count, offset);
+        if (done < 0 && errno == EINTR)
+            continue;
+        if (done <= 0)
+            throw std::runtime_error("Error in reading temporary file: " + path + ": " + (done < 0 ? strerror(errno) : "unexpected end of file"));
+        out += done;
+        offset += done;
+        count -= done;
+    }
+}
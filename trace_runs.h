@@ -0,0 +1,65 @@
+#ifndef TRACE_RUNS_H
+#define TRACE_RUNS_H
+
+#include <string>
+#include <vector>
+#include <cstddef>
+#include "seismogram.h"
+
+// Temporary file for transposing more samples than fit in memory: blocks of time
+// steps of all traces (runs) are appended trace-major, each trace taking one
+// contiguous piece of its run, and later whole traces are read back across all the
+// runs. The file is unlinked as soon as it is created, so it is removed however
+// the program ends. Errors are reported by std::runtime_error.
+class TraceRunFile
+{
+public:
+
+    TraceRunFile();
+    ~TraceRunFile();
+
+    // Creates the file at path for runs of num_of_traces traces with samples of sample_size bytes
+    void Create(const std::string& path, IndexType num_of_traces, size_t sample_size);
+    void Close();
+
+    // Appends a run of num_of_samples samples per trace: the samples of trace i
+    // start at data + i * stride bytes
+    void AppendRun(const void * data, size_t stride, size_t num_of_samples);
+    // Appends a run of num_of_samples samples per trace that are given one trace at a
+    // time by AppendTrace, in the order of the traces; EndRun writes the rest out
+    void BeginRun(size_t num_of_samples);
+    void AppendTrace(const void * samples);
+    void EndRun();
+
+    // Reads the samples of all the runs of traces [first, first + count): trace i
+    // gets NumSamples() samples at out + (i - first) * stride bytes
+    void ReadTraces(IndexType first, IndexType count, void * out, size_t stride);
+    // Reads samples [first_sample, first_sample + count) of one trace across the runs into out,
+    // it may be called from several threads at once
+    void ReadSamples(IndexType trace, size_t first_sample, size_t count, void * out);
+
+    // Samples of a trace in all the runs
+    size_t NumSamples() const { return num_of_samples; }
+    size_t NumRuns() const { return run_offsets.size(); }
+
+private:
+
+    TraceRunFile(const TraceRunFile&);
+    TraceRunFile& operator=(const TraceRunFile&);
+
+    void write_at(const void * data, size_t count, uint64 offset);
+    void read_at(void * data, size_t count, uint64 offset);
+
+    std::string path;
+    int fd;
+    IndexType num_of_traces;
+    size_t sample_size;
+    size_t num_of_samples;
+    uint64 file_end;
+    // Offset and samples per trace of every run
+    std::vector<uint64> run_offsets;
+    std::vector<size_t> run_samples;
+    std::vector<char> buffer;
+};
+
+#endif // TRACE_RUNS_H
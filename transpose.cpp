@@ -0,0 +1,98 @@
+#include "transpose.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define TRANSPOSE_X86
+#include <immintrin.h>
+#endif
+
+typedef void (*transpose_kernel)(const float * src, size_t src_stride, float * dst, size_t dst_stride, size_t rows, size_t cols);
+
+static void transpose_scalar(const float * src, size_t src_stride, float * dst, size_t dst_stride, size_t rows, size_t cols)
+{
+    transpose<float>(src, src_stride, dst, dst_stride, rows, cols);
+}
+
+#ifdef TRANSPOSE_X86
+
+__attribute__((target("avx2")))
+static inline void transpose_8x8_avx2(const float * src, size_t src_stride, float * dst, size_t dst_stride)
+{
+    __m256 r0 = _mm256_loadu_ps(src + 0 * src_stride);
+    __m256 r1 = _mm256_loadu_ps(src + 1 * src_stride);
+    __m256 r2 = _mm256_loadu_ps(src + 2 * src_stride);
+    __m256 r3 = _mm256_loadu_ps(src + 3 * src_stride);
+    __m256 r4 = _mm256_loadu_ps(src + 4 * src_stride);
+    __m256 r5 = _mm256_loadu_ps(src + 5 * src_stride);
+    __m256 r6 = _mm256_loadu_ps(src + 6 * src_stride);
+    __m256 r7 = _mm256_loadu_ps(src + 7 * src_stride);
+
+    __m256 t0 = _mm256_unpacklo_ps(r0, r1);
+    __m256 t1 = _mm256_unpackhi_ps(r0, r1);
+    __m256 t2 = _mm256_unpacklo_ps(r2, r3);
+    __m256 t3 = _mm256_unpackhi_ps(r2, r3);
+    __m256 t4 = _mm256_unpacklo_ps(r4, r5);
+    __m256 t5 = _mm256_unpackhi_ps(r4, r5);
+    __m256 t6 = _mm256_unpacklo_ps(r6, r7);
+    __m256 t7 = _mm256_unpackhi_ps(r6, r7);
+
+    __m256 s0 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1, 0, 1, 0));
+    __m256 s1 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3, 2, 3, 2));
+    __m256 s2 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1, 0, 1, 0));
+    __m256 s3 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(3, 2, 3, 2));
+    __m256 s4 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(1, 0, 1, 0));
+    __m256 s5 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(3, 2, 3, 2));
+    __m256 s6 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(1, 0, 1, 0));
+    __m256 s7 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(3, 2, 3, 2));
+
+    _mm256_storeu_ps(dst + 0 * dst_stride, _mm256_permute2f128_ps(s0, s4, 0x20));
+    _mm256_storeu_ps(dst + 1 * dst_stride, _mm256_permute2f128_ps(s1, s5, 0x20));
+    _mm256_storeu_ps(dst + 2 * dst_stride, _mm256_permute2f128_ps(s2, s6, 0x20));
+    _mm256_storeu_ps(dst + 3 * dst_stride, _mm256_permute2f128_ps(s3, s7, 0x20));
+    _mm256_storeu_ps(dst + 4 * dst_stride, _mm256_permute2f128_ps(s0, s4, 0x31));
+    _mm256_storeu_ps(dst + 5 * dst_stride, _mm256_permute2f128_ps(s1, s5, 0x31));
+    _mm256_storeu_ps(dst + 6 * dst_stride, _mm256_permute2f128_ps(s2, s6, 0x31));
+    _mm256_storeu_ps(dst + 7 * dst_stride, _mm256_permute2f128_ps(s3, s7, 0x31));
+}
+
+__attribute__((target("avx2")))
+static void transpose_avx2(const float * src, size_t src_stride, float * dst, size_t dst_stride, size_t rows, size_t cols)
+{
+    for (size_t r0 = 0; r0 < rows; r0 += TRANSPOSE_BLOCK)
+    {
+        size_t r1 = std::min(rows, r0 + TRANSPOSE_BLOCK);
+        size_t r8 = r0 + (r1 - r0) / 8 * 8;
+        for (size_t c0 = 0; c0 < cols; c0 += TRANSPOSE_BLOCK)
+        {
+            size_t c1 = std::min(cols, c0 + TRANSPOSE_BLOCK);
+            size_t c8 = c0 + (c1 - c0) / 8 * 8;
+            for (size_t r = r0; r < r8; r += 8)
+                for (size_t c = c0; c < c8; c += 8)
+                    transpose_8x8_avx2(src + r * src_stride + c, src_stride, dst + c * dst_stride + r, dst_stride);
+            // Edges of the block that don't fill a whole tile
+            for (size_t r = r0; r < r8; r++)
+                for (size_t c = c8; c < c1; c++)
+                    dst[c * dst_stride + r] = src[r * src_stride + c];
+            for (size_t r = r8; r < r1; r++)
+                for (size_t c = c0; c < c1; c++)
+                    dst[c * dst_stride + r] = src[r * src_stride + c];
+        }
+    }
+}
+
+#endif // TRANSPOSE_X86
+
+static transpose_kernel select_kernel()
+{
+#ifdef TRANSPOSE_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return transpose_avx2;
+#endif
+    return transpose_scalar;
+}
+
+void transpose(const float * src, size_t src_stride, float * dst, size_t dst_stride, size_t rows, size_t cols)
+{
+    static const transpose_kernel kernel = select_kernel();
+    kernel(src, src_stride, dst, dst_stride, rows, cols);
+}
@@ -0,0 +1,32 @@
+#ifndef TRANSPOSE_H
+#define TRANSPOSE_H
+
+#include <cstddef>
+#include <algorithm>
+
+// Side of the square blocks a transpose is split into, a pair of blocks stays in L1 cache
+#define TRANSPOSE_BLOCK 64
+
+// Writes dst[c * dst_stride + r] = src[r * src_stride + c] for r < rows and c < cols,
+// strides are in elements; src and dst must not overlap.
+// Used to turn trace-major seismograms into time-major CSV rows and back.
+template <typename T>
+void transpose(const T * src, size_t src_stride, T * dst, size_t dst_stride, size_t rows, size_t cols)
+{
+    for (size_t r0 = 0; r0 < rows; r0 += TRANSPOSE_BLOCK)
+    {
+        size_t r1 = std::min(rows, r0 + TRANSPOSE_BLOCK);
+        for (size_t c0 = 0; c0 < cols; c0 += TRANSPOSE_BLOCK)
+        {
+            size_t c1 = std::min(cols, c0 + TRANSPOSE_BLOCK);
+            for (size_t r = r0; r < r1; r++)
+                for (size_t c = c0; c < c1; c++)
+                    dst[c * dst_stride + r] = src[r * src_stride + c];
+        }
+    }
+}
+
+// Same for floats, 8x8 tiles are transposed in AVX2 registers when the CPU supports it
+void transpose(const float * src, size_t src_stride, float * dst, size_t dst_stride, size_t rows, size_t cols);
+
+#endif // TRANSPOSE_H